@@ -26,9 +26,14 @@ extern "C" {
 }
 #include <boost/filesystem.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/shared_array.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/weak_ptr.hpp>
 #include <luabind/luabind.hpp>
+#include <map>
+#include <SDL2/SDL.h>
+#include <vector>
 
 namespace lev
 {
@@ -49,16 +54,345 @@ namespace lev
     }
   }
 
+  // guards the shared archive handles, which are also used by the loader threads
+  class archive_locker
+  {
+    public:
+      archive_locker()
+      {
+        SDL_LockMutex(get_mutex());
+      }
+
+      ~archive_locker()
+      {
+        SDL_UnlockMutex(get_mutex());
+      }
+
+      static SDL_mutex *get_mutex()
+      {
+        static SDL_mutex *mutex = SDL_CreateMutex();
+        return mutex;
+      }
+  };
+
+  static bool has_wildcard(const std::string &pattern)
+  {
+    return pattern.find_first_of("*?") != std::string::npos;
+  }
+
+  // entry data read straight from the archive file behind an SDL_RWops,
+  // deflated entries are inflated on demand with checkpoints for the backward seeks
+  class entry_stream
+  {
+    public:
+      enum
+      {
+        // uncompressed bytes between the checkpoints
+        CHECKPOINT_SPAN = 1024 * 1024,
+        IN_SIZE = 16 * 1024,
+        // deflate window, also the dictionary saved in the checkpoints
+        WINDOW_SIZE = 32 * 1024
+      };
+
+      // decoder state at a deflate block boundary
+      struct checkpoint
+      {
+        Sint64 in, out;
+        int bits;
+        boost::shared_array<unsigned char> window;
+      };
+
+    protected:
+      entry_stream() :
+        src(NULL), offset(0), compressed_size(0), size(0), deflated(false),
+        zs(), zs_ready(false), in_read(0), out_pos(0), pos(0),
+        filled(0), consumed(0), points()
+      { }
+    public:
+      ~entry_stream()
+      {
+        if (zs_ready) { inflateEnd(&zs); }
+        if (src) { src->close(src); }
+      }
+
+      static SDL_RWops *open(const std::string &archive_path, Sint64 offset,
+                             Sint64 compressed_size, Sint64 size, bool deflated)
+      {
+        entry_stream *s = NULL;
+        try {
+          s = new entry_stream;
+          if (! s) { throw -1; }
+          s->src = SDL_RWFromFile(archive_path.c_str(), "rb");
+          if (! s->src) { throw -2; }
+          s->offset = offset;
+          s->compressed_size = compressed_size;
+          s->size = size;
+          s->deflated = deflated;
+          if (deflated)
+          {
+            memset(&s->zs, 0, sizeof(s->zs));
+            if (inflateInit2(&s->zs, -MAX_WBITS) != Z_OK) { throw -3; }
+            s->zs_ready = true;
+            if (! s->restart(NULL)) { throw -4; }
+          }
+
+          SDL_RWops *ops = SDL_AllocRW();
+          if (! ops) { throw -5; }
+          ops->type = SDL_RWOPS_UNKNOWN;
+          ops->size = size_rw;
+          ops->seek = seek_rw;
+          ops->read = read_rw;
+          ops->write = write_rw;
+          ops->close = close_rw;
+          ops->hidden.unknown.data1 = s;
+          return ops;
+        }
+        catch (...) {
+          delete s;
+          lev::debug_print("error on archive entry stream opening");
+        }
+        return NULL;
+      }
+
+      // null dst only skips the bytes
+      size_t read(unsigned char *dst, size_t n)
+      {
+        if (! deflated)
+        {
+          Sint64 rest = size - pos;
+          if (rest <= 0) { return 0; }
+          if ((Sint64)n > rest) { n = rest; }
+          if (src->seek(src, offset + pos, RW_SEEK_SET) < 0) { return 0; }
+          size_t readed = dst ? src->read(src, dst, 1, n) : n;
+          pos += readed;
+          return readed;
+        }
+
+        size_t done = 0;
+        while (done < n)
+        {
+          if (consumed == filled && ! inflate_more()) { break; }
+          size_t len = std::min<size_t>(n - done, filled - consumed);
+          if (dst) { memcpy(dst + done, window + consumed, len); }
+          consumed += len;
+          done += len;
+        }
+        return done;
+      }
+
+      Sint64 seek(Sint64 target)
+      {
+        if (target < 0) { target = 0; }
+        if (target > size) { target = size; }
+        if (! deflated)
+        {
+          pos = target;
+          return pos;
+        }
+
+        Sint64 current = tell();
+        Sint64 window_begin = out_pos - filled;
+        if (target < current && target >= window_begin)
+        {
+          // still in the window
+          consumed = target - window_begin;
+          return target;
+        }
+
+        // resuming from the last checkpoint before the target if it saves inflating
+        const checkpoint *p = NULL;
+        for (int i = points.size() - 1; i >= 0; i--)
+        {
+          if (points[i].out <= target) { p = &points[i]; break; }
+        }
+        if (target < current || (p && p->out > current))
+        {
+          if (! restart(p)) { return -1; }
+          current = tell();
+        }
+        if (target > current)
+        {
+          // skipping forward, inflating without copying
+          size_t skip = target - current;
+          if (read(NULL, skip) != skip) { return -1; }
+        }
+        return tell();
+      }
+
+      Sint64 tell() const
+      {
+        if (! deflated) { return pos; }
+        return out_pos - (filled - consumed);
+      }
+
+    protected:
+
+      // inflating the next piece into the window, false at the end of the entry
+      bool inflate_more()
+      {
+        if (out_pos >= size) { return false; }
+        // the window is reused after everything in it was consumed
+        if (filled == WINDOW_SIZE) { filled = consumed = 0; }
+        zs.next_out = window + filled;
+        zs.avail_out = WINDOW_SIZE - filled;
+        while (zs.next_out == window + filled)
+        {
+          if (zs.avail_in == 0)
+          {
+            Sint64 rest = compressed_size - in_read;
+            if (rest <= 0) { return false; }
+            size_t readed = src->read(src, in, 1, std::min<Sint64>(IN_SIZE, rest));
+            if (readed == 0) { return false; }
+            in_read += readed;
+            zs.next_in = in;
+            zs.avail_in = readed;
+          }
+          int result = inflate(&zs, Z_BLOCK);
+          if (result == Z_STREAM_END) { break; }
+          if (result != Z_OK && result != Z_BUF_ERROR) { return false; }
+          // the end of a block except the last one, the state fits in a checkpoint
+          if ((zs.data_type & 128) && ! (zs.data_type & 64)) { mark(); }
+        }
+        int produced = zs.next_out - (window + filled);
+        filled += produced;
+        out_pos += produced;
+        return produced > 0;
+      }
+
+      bool mark()
+      {
+        const int end = zs.next_out - window;
+        const Sint64 out = out_pos + (end - filled);
+        if (out - (points.empty() ? 0 : points.back().out) < CHECKPOINT_SPAN) { return false; }
+
+        checkpoint p;
+        p.in = in_read - zs.avail_in;
+        p.out = out;
+        p.bits = zs.data_type & 7;
+        p.window.reset(new unsigned char[WINDOW_SIZE]);
+        // the window is circular, the oldest byte is just after the newest one
+        memcpy(p.window.get(), window + end, WINDOW_SIZE - end);
+        memcpy(p.window.get() + WINDOW_SIZE - end, window, end);
+        points.push_back(p);
+        return true;
+      }
+
+      // restarting the decoder at the checkpoint, or at the beginning for NULL
+      bool restart(const checkpoint *p)
+      {
+        if (inflateReset(&zs) != Z_OK) { return false; }
+        zs.avail_in = 0;
+        in_read = p ? p->in - (p->bits ? 1 : 0) : 0;
+        out_pos = p ? p->out : 0;
+        filled = consumed = 0;
+        if (src->seek(src, offset + in_read, RW_SEEK_SET) < 0) { return false; }
+        if (! p) { return true; }
+
+        if (p->bits)
+        {
+          unsigned char byte;
+          if (src->read(src, &byte, 1, 1) != 1) { return false; }
+          in_read++;
+          inflatePrime(&zs, p->bits, byte >> (8 - p->bits));
+        }
+        inflateSetDictionary(&zs, p->window.get(), WINDOW_SIZE);
+        // continuing the window from the dictionary, for the later checkpoints
+        memcpy(window, p->window.get(), WINDOW_SIZE);
+        filled = consumed = WINDOW_SIZE;
+        return true;
+      }
+
+      static entry_stream *get(SDL_RWops *ops)
+      {
+        return (entry_stream *)ops->hidden.unknown.data1;
+      }
+
+      static int SDLCALL close_rw(SDL_RWops *ops)
+      {
+        delete get(ops);
+        SDL_FreeRW(ops);
+        return 0;
+      }
+
+      static size_t SDLCALL read_rw(SDL_RWops *ops, void *ptr, size_t size, size_t maxnum)
+      {
+        if (size == 0) { return 0; }
+        return get(ops)->read((unsigned char *)ptr, size * maxnum) / size;
+      }
+
+      static Sint64 SDLCALL seek_rw(SDL_RWops *ops, Sint64 offset, int whence)
+      {
+        entry_stream *s = get(ops);
+        if (whence == RW_SEEK_CUR) { offset += s->tell(); }
+        else if (whence == RW_SEEK_END) { offset += s->size; }
+        return s->seek(offset);
+      }
+
+      static Sint64 SDLCALL size_rw(SDL_RWops *ops)
+      {
+        return get(ops)->size;
+      }
+
+      static size_t SDLCALL write_rw(SDL_RWops *ops, const void *ptr, size_t size, size_t num)
+      {
+        SDL_SetError("archive entry streams are read-only");
+        return 0;
+      }
+
+      SDL_RWops *src;
+      Sint64 offset;
+      Sint64 compressed_size;
+      Sint64 size;
+      bool deflated;
+
+      z_stream zs;
+      bool zs_ready;
+      unsigned char in[IN_SIZE];
+      // compressed bytes read from offset, uncompressed bytes inflated
+      Sint64 in_read;
+      Sint64 out_pos;
+      // position of the stored entries
+      Sint64 pos;
+
+      // [consumed, filled) of the window is inflated but not read yet
+      unsigned char window[WINDOW_SIZE];
+      int filled;
+      int consumed;
+      std::vector<checkpoint> points;
+  };
+
   // archive class implementation
   class impl_archive : public archive
   {
     public:
       typedef boost::shared_ptr<impl_archive> ptr;
+
+      // entries of this size or larger are extracted as streams
+      enum { STREAM_THRESHOLD = 1024 * 1024 };
+
+      // central directory entry, cached on reading start
+      struct entry_type
+      {
+        std::string name;
+        unz64_file_pos pos;
+        ZPOS64_T compressed_size;
+        ZPOS64_T uncompressed_size;
+      };
+
+      // shared reader, valid while the file is unmodified
+      struct pooled_type
+      {
+        impl_archive::ptr arc;
+        std::time_t mtime;
+        boost::uintmax_t size;
+      };
+
     protected:
       impl_archive() :
         archive(),
         r(NULL), w(NULL),
-        current_opened(false)
+        current_opened(false), mapped(),
+        entries(), index(), find_pos(-1)
       { }
     public:
       virtual ~impl_archive()
@@ -73,6 +407,7 @@ namespace lev
                             const char *compression_method = "gzip",
                             int compression_level = 1)
       {
+        archive_locker lock;
         if (entry_name.empty()) { return false; }
         if (! w)
         {
@@ -196,15 +531,25 @@ namespace lev
       static bool entry_exists_direct(const std::string &archive_file,
                                       const std::string &entry_name)
       {
-        archive::ptr arc = archive::open(archive_file);
+        archive::ptr arc = archive::open_shared(archive_file);
         if (! arc) { return false; }
         return arc->entry_exists(entry_name);
       }
 
       virtual file::ptr extract(const std::string &entry_name, const char *password = NULL)
       {
+        archive_locker lock;
         if (! entry_exists(entry_name)) { return memfile::ptr(); }
+        // stored entries are served from the mapped archive without copying
+        file::ptr view = view_current();
+        if (view) { return view; }
         int size = get_uncompressed_size_current();
+        // large entries (music, movies) are streamed not to keep them in memory
+        if (size >= STREAM_THRESHOLD)
+        {
+          file::ptr f = open_stream(entry_name, password);
+          if (f) { return f; }
+        }
         memfile::ptr mem = memfile::create(size);
         if (! mem) { return memfile::ptr(); }
         if (read_raw(mem->get_buffer(), size, password) < 0) { return memfile::ptr(); }
@@ -222,7 +567,7 @@ namespace lev
                                       const std::string &entry_name,
                                       const char *password)
       {
-        archive::ptr arc = archive::open(archive_file);
+        archive::ptr arc = archive::open_shared(archive_file);
         if (! arc) { return memfile::ptr(); }
         return arc->extract(entry_name);
       }
@@ -232,7 +577,7 @@ namespace lev
                                      const std::string &target,
                                      const char *password)
       {
-        archive::ptr arc = archive::open(archive_file);
+        archive::ptr arc = archive::open_shared(archive_file);
         if (! arc) { return false; }
         return arc->extract_to(entry_name, target);
       }
@@ -264,21 +609,21 @@ namespace lev
 
       virtual bool find(const std::string &pattern, std::string &entry_name)
       {
-        const int buffer_size = 1024;
-        char buffer[buffer_size];
-
-        if (! start_reading()) { return NULL; }
+        archive_locker lock;
+        if (! start_reading()) { return false; }
         last_find = pattern;
+        find_pos = -1;
 
-        if (unzGetCurrentFileInfo64(r, /* info */ NULL, buffer, buffer_size,
-              /* extra */ NULL, /* extra size */ 0,
-              /* comment */ NULL, /* comment size */ 0) == UNZ_OK)
+        if (! has_wildcard(pattern))
         {
-          if (strmatch(last_find.c_str(), buffer))
+          // exact name, looking up the index
+          boost::unordered_map<std::string, int>::iterator found = index.find(pattern);
+          if (found == index.end())
           {
-            entry_name = buffer;
-            return true;
+            last_find = "";
+            return false;
           }
+          return go_to(found->second, entry_name);
         }
         return find_next(entry_name);
       }
@@ -305,30 +650,21 @@ namespace lev
 
       virtual bool find_next(std::string &entry_name)
       {
-        const int buffer_size = 1024;
-        char buffer[buffer_size];
+        archive_locker lock;
         current_opened = false;
 
         if (last_find.empty()) { return false; }
-        for ( ; ; )
+        if (! r) { return false; }
+        for (int i = find_pos + 1; i < entries.size(); i++)
         {
-          if (unzGoToNextFile(r) != UNZ_OK)
+//printf("CURRENT FILE: %s\n", entries[i].name.c_str());
+          if (strmatch(last_find.c_str(), entries[i].name.c_str()))
           {
-            last_find = "";
-            return false;
-          }
-          if (unzGetCurrentFileInfo64(r, /* info */ NULL, buffer, buffer_size,
-                /* extra */ NULL, /* extra size */ 0,
-                /* comment */ NULL, /* comment size */ 0) == UNZ_OK)
-          {
-//printf("CURRENT FILE: %s\n", buffer);
-            if (strmatch(last_find.c_str(), buffer))
-            {
-              entry_name = buffer;
-              return true;
-            }
+            return go_to(i, entry_name);
           }
         }
+        last_find = "";
+        return false;
       }
 
       static int find_next_l(lua_State *L)
@@ -351,7 +687,7 @@ namespace lev
                               const std::string &pattern,
                               std::string &entry_name)
       {
-        archive::ptr arc = archive::open(archive_file);
+        archive::ptr arc = archive::open_shared(archive_file);
         if (! arc) { return false; }
         return arc->find(pattern, entry_name);
       }
@@ -389,30 +725,39 @@ namespace lev
 
       virtual bool flush()
       {
+        archive_locker lock;
         if (r)
         {
           unzClose(r);
           r = NULL;
         }
+        entries.clear();
+        index.clear();
+        find_pos = -1;
         if (w)
         {
           zipClose(w, NULL);
           w = NULL;
         }
+        // the views keep their own reference to the mapping
+        mapped.reset();
         current_opened = false;
         return true;
       }
 
       virtual long get_uncompressed_size(const std::string &entry_name)
       {
+        archive_locker lock;
         if (! entry_exists(entry_name)) { return -1; }
         return get_uncompressed_size_current();
       }
 
       virtual long get_uncompressed_size_current()
       {
+        archive_locker lock;
         unz_file_info64 info;
 
+        if (r && find_pos >= 0) { return entries[find_pos].uncompressed_size; }
         if (unzGetCurrentFileInfo64(r, &info,
                                     NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
         { return -1; }
@@ -422,16 +767,15 @@ namespace lev
       static long get_uncompressed_size_direct(const std::string &archive_file,
                                                const std::string &entry_name)
       {
-        archive::ptr arc = archive::open(archive_file);
+        archive::ptr arc = archive::open_shared(archive_file);
         if (! arc) { return -1; }
         return arc->get_uncompressed_size(entry_name);
       }
 
       static bool is_archive(const std::string &filename)
       {
-        unzFile r = unzOpen64(filename.c_str());
-        if (! r) { return false; }
-        return true;
+        if (open_shared(filename)) { return true; }
+        return false;
       }
 
       static impl_archive::ptr open(const std::string &archive_path)
@@ -460,18 +804,109 @@ namespace lev
         return arc;
       }
 
+      virtual file::ptr open_stream(const std::string &entry_name, const char *password = NULL)
+      {
+        archive_locker lock;
+        file::ptr f;
+        if (! entry_exists(entry_name)) { return f; }
+        const entry_type &e = entries[find_pos];
+
+        int method = 0;
+        ZPOS64_T offset = 0;
+        if (! locate_current(method, offset)) { return f; }
+        if (method != 0 && method != Z_DEFLATED) { return f; }
+
+        SDL_RWops *ops = entry_stream::open(archive_path, offset, e.compressed_size,
+                                            e.uncompressed_size, method == Z_DEFLATED);
+        if (! ops) { return f; }
+        f = file::adopt_ops(ops);
+        if (! f) { ops->close(ops); }
+        return f;
+      }
+
+      static impl_archive::ptr open_reader(const std::string &archive_path)
+      {
+        impl_archive::ptr arc;
+        if (archive_path.empty()) { return arc; }
+        try {
+          arc.reset(new impl_archive);
+          if (! arc) { throw -1; }
+          arc->archive_path = archive_path;
+          if (! arc->start_reading()) { throw -2; }
+          return arc;
+        }
+        catch (...) {
+          arc.reset();
+        }
+        return arc;
+      }
+
+      static impl_archive::ptr open_shared(const std::string &archive_path)
+      {
+        archive_locker lock;
+        static std::map<std::string, pooled_type> *pool = NULL;
+        impl_archive::ptr arc;
+
+        try {
+          if (! pool) { pool = new std::map<std::string, pooled_type>; }
+          if (! fs::is_file(archive_path))
+          {
+            pool->erase(archive_path);
+            return arc;
+          }
+
+          std::time_t mtime = boost::filesystem::last_write_time(archive_path);
+          boost::uintmax_t size = boost::filesystem::file_size(archive_path);
+          std::map<std::string, pooled_type>::iterator found = pool->find(archive_path);
+          if (found != pool->end())
+          {
+            pooled_type &p = found->second;
+            if (p.mtime == mtime && p.size == size)
+            {
+              // the writer may have been started on the shared one
+              if (p.arc && ! p.arc->start_reading()) { return arc; }
+              return p.arc;
+            }
+          }
+
+          // non-archive files are also remembered not to retry unzOpen64
+          pooled_type p;
+          p.arc = open_reader(archive_path);
+          p.mtime = mtime;
+          p.size = size;
+          (*pool)[archive_path] = p;
+          return p.arc;
+        }
+        catch (...) {
+          lev::debug_print("error on shared archive opening");
+        }
+        return arc;
+      }
+
       virtual bool read(const std::string &entry_name, std::string &data,
                         int block_size, const char *password)
       {
+        archive_locker lock;
         if (! entry_exists(entry_name)) { return false; }
         return read_current(data, block_size, password);
       }
 
       virtual bool read_current(std::string &data, int block_size, const char *password)
       {
+        archive_locker lock;
         try {
           if (block_size < 0) { throw -1; }
-          else if (block_size == 0)
+          else if (block_size == 0 && ! current_opened)
+          {
+            // whole stored entry, copied once from the mapped archive
+            file::ptr view = view_current();
+            if (view)
+            {
+              data.assign((const char *)view->get_data(), view->get_size());
+              return true;
+            }
+          }
+          if (block_size == 0)
           {
             block_size = get_uncompressed_size_current();
             if (block_size < 0) { throw -2; }
@@ -565,8 +1000,8 @@ namespace lev
                               int block_size,
                               const char *password)
       {
-        archive::ptr arc = archive::open(archive_file);
-        if (! arc) { throw -1; }
+        archive::ptr arc = archive::open_shared(archive_file);
+        if (! arc) { return false; }
         return arc->read(entry_name, data, block_size, password);
       }
 
@@ -616,12 +1051,79 @@ namespace lev
         }
       }
 
+      bool go_to(int i, std::string &entry_name)
+      {
+        current_opened = false;
+        if (unzGoToFilePos64(r, &entries[i].pos) != UNZ_OK) { return false; }
+        find_pos = i;
+        entry_name = entries[i].name;
+        return true;
+      }
+
+      // locating the data of the current entry in the archive file,
+      // false for the encrypted entries whose decryption is left to minizip
+      bool locate_current(int &method, ZPOS64_T &offset)
+      {
+        unz_file_info64 info;
+        if (unzGetCurrentFileInfo64(r, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK) { return false; }
+        if (info.flag & 1) { return false; }
+
+        // raw opening, only to get the position
+        int level = 0;
+        current_opened = false;
+        if (unzOpenCurrentFile2(r, &method, &level, 1) != UNZ_OK) { return false; }
+        offset = unzGetCurrentFileZStreamPos64(r);
+        unzCloseCurrentFile(r);
+        return true;
+      }
+
+      // walking the central directory once, instead of on every lookup
+      bool make_index()
+      {
+        const int buffer_size = 1024;
+        char buffer[buffer_size];
+        unz_file_info64 info;
+
+        entries.clear();
+        index.clear();
+        try {
+          for (int result = unzGoToFirstFile(r); result == UNZ_OK; result = unzGoToNextFile(r))
+          {
+            if (unzGetCurrentFileInfo64(r, &info, buffer, buffer_size,
+                  /* extra */ NULL, /* extra size */ 0,
+                  /* comment */ NULL, /* comment size */ 0) != UNZ_OK) { continue; }
+            entry_type e;
+            e.name = buffer;
+            if (unzGetFilePos64(r, &e.pos) != UNZ_OK) { continue; }
+            e.compressed_size = info.compressed_size;
+            e.uncompressed_size = info.uncompressed_size;
+            // the first one wins for the duplicated names, as the linear search
+            if (index.find(e.name) == index.end()) { index[e.name] = entries.size(); }
+            entries.push_back(e);
+          }
+        }
+        catch (...) {
+          entries.clear();
+          index.clear();
+          lev::debug_print("error on archive index building");
+          return false;
+        }
+        return true;
+      }
+
       bool start_reading()
       {
+        // reusing the opened reader and its index
+        if (r) { return true; }
         flush();
         r = unzOpen64(archive_path.c_str());
 
         if (! r) { return false; }
+        if (! make_index())
+        {
+          flush();
+          return false;
+        }
         return true;
       }
 
@@ -634,11 +1136,30 @@ namespace lev
         return true;
       }
 
+      // read-only view of the current entry if it is stored, NULL otherwise
+      file::ptr view_current()
+      {
+        file::ptr f;
+        if (! r || find_pos < 0) { return f; }
+        int method = -1;
+        ZPOS64_T offset = 0;
+        if (! locate_current(method, offset) || method != 0) { return f; }
+        if (! mapped) { mapped = file::open_mapped(archive_path); }
+        if (! mapped) { return f; }
+        return file::open_view(mapped, offset, entries[find_pos].uncompressed_size);
+      }
+
       unzFile r;
       zipFile w;
       std::string archive_path;
       std::string last_find;
       bool current_opened;
+      // whole archive mapped for the stored entries
+      file::ptr mapped;
+      // cached central directory
+      std::vector<entry_type> entries;
+      boost::unordered_map<std::string, int> index;
+      int find_pos;
   };
 
   bool archive::entry_exists_direct(const std::string &archive_file,
@@ -685,6 +1206,11 @@ namespace lev
     return impl_archive::open(archive_path);
   }
 
+  archive::ptr archive::open_shared(const std::string &archive_path)
+  {
+    return impl_archive::open_shared(archive_path);
+  }
+
   bool archive::read_direct(const std::string &archive_file,
                             const std::string &entry_name,
                             std::string &data,
@@ -695,6 +1221,294 @@ namespace lev
                                      data, block_size, password);
   }
 
+
+  class impl_archive_builder : public archive_builder
+  {
+    public:
+      typedef boost::shared_ptr<impl_archive_builder> ptr;
+
+      // entries packed ahead of the writer at most, bounding the memory use
+      enum { WINDOW_PER_THREAD = 8 };
+
+      enum job_state
+      {
+        JOB_QUEUED = 0,
+        JOB_PACKED,
+        JOB_FAILED,
+      };
+
+      struct job_type
+      {
+        job_type(const std::string &name, const std::string &path, int level) :
+          name(name), path(path), data(), packed(),
+          level(level), method(0), crc(0), state(JOB_QUEUED)
+        { }
+
+        // reading, checksumming and deflating, on a worker thread,
+        // false instead of throwing (e.g. bad_alloc on a large entry)
+        bool pack()
+        {
+          try {
+            if (pack_data()) { return true; }
+          }
+          catch (...) {
+            // reported by commit() on the calling thread
+          }
+          std::string().swap(data);
+          std::string().swap(packed);
+          return false;
+        }
+
+        bool pack_data()
+        {
+          if (! path.empty())
+          {
+            file::ptr f = file::open(path);
+            if (! f) { return false; }
+            if (! f->read_all(data)) { return false; }
+          }
+          crc = crc32(0, (const Bytef *)data.data(), data.length());
+          method = 0;
+          if (level < 0 || data.empty()) { return true; }
+
+          // allocated before the deflater, which would leak on bad_alloc
+          packed.resize(compressBound(data.length()));
+          z_stream z;
+          memset(&z, 0, sizeof(z));
+          if (deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS,
+                           DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) { return false; }
+          z.next_in = (Bytef *)data.data();
+          z.avail_in = data.length();
+          z.next_out = (Bytef *)&packed[0];
+          z.avail_out = packed.length();
+          int result = deflate(&z, Z_FINISH);
+          deflateEnd(&z);
+          if (result != Z_STREAM_END) { return false; }
+          packed.resize(z.total_out);
+
+          // keeping incompressible data as it is
+          if (packed.length() >= data.length()) { std::string().swap(packed); }
+          else { method = Z_DEFLATED; }
+          return true;
+        }
+
+        std::string name, path;
+        std::string data, packed;
+        int level, method;
+        unsigned long crc;
+        // guarded by the mutex
+        int state;
+      };
+
+    protected:
+      impl_archive_builder() :
+        archive_builder(),
+        archive_path(), threads(0),
+        mutex(NULL), cond(NULL), jobs(), workers(),
+        written(0)
+      {
+        SDL_AtomicSet(&next, 0);
+      }
+    public:
+      virtual ~impl_archive_builder()
+      {
+        if (cond) { SDL_DestroyCond(cond); }
+        if (mutex) { SDL_DestroyMutex(mutex); }
+      }
+
+      virtual bool add_data(const std::string &entry_name, const std::string &data,
+                            int compression_level)
+      {
+        if (entry_name.empty()) { return false; }
+        if (compression_level > 9) { compression_level = 9; }
+        jobs.push_back(job_type(entry_name, "", compression_level));
+        jobs.back().data = data;
+        return true;
+      }
+
+      virtual bool add_file_to(const std::string &file, const std::string &entry_name,
+                               int compression_level)
+      {
+        if (file.empty() || entry_name.empty()) { return false; }
+        if (compression_level > 9) { compression_level = 9; }
+        jobs.push_back(job_type(entry_name, file, compression_level));
+        return true;
+      }
+
+      virtual bool commit()
+      {
+        if (jobs.empty()) { return true; }
+        zipFile w = NULL;
+        if (fs::is_file(archive_path))
+        {
+          w = zipOpen64(archive_path.c_str(), APPEND_STATUS_ADDINZIP);
+        }
+        else
+        {
+          w = zipOpen64(archive_path.c_str(), APPEND_STATUS_CREATE);
+        }
+        if (! w)
+        {
+          lev::debug_print("error on archive opening: " + archive_path);
+          return false;
+        }
+
+        written = 0;
+        SDL_AtomicSet(&next, 0);
+        for (int i = 0; i < threads; i++)
+        {
+          SDL_Thread *th = SDL_CreateThread(impl_archive_builder::worker_main,
+                                            "lev.archive_builder", this);
+          if (! th) { break; }
+          workers.push_back(th);
+        }
+
+        bool success = true;
+        for (int i = 0; i < jobs.size(); i++)
+        {
+          job_type &job = jobs[i];
+          if (workers.empty())
+          {
+            // packing by ourselves if no worker could start
+            job.state = job.pack() ? JOB_PACKED : JOB_FAILED;
+          }
+          else
+          {
+            SDL_LockMutex(mutex);
+            while (job.state == JOB_QUEUED) { SDL_CondWait(cond, mutex); }
+            SDL_UnlockMutex(mutex);
+          }
+
+          if (job.state == JOB_FAILED)
+          {
+            lev::debug_print("error on archive entry packing: " + job.name);
+            success = false;
+          }
+          else if (! write_entry(w, job))
+          {
+            lev::debug_print("error on archive entry writing: " + job.name);
+            success = false;
+          }
+          std::string().swap(job.data);
+          std::string().swap(job.packed);
+
+          SDL_LockMutex(mutex);
+          written = i + 1;
+          SDL_CondBroadcast(cond);
+          SDL_UnlockMutex(mutex);
+        }
+
+        for (int i = 0; i < workers.size(); i++) { SDL_WaitThread(workers[i], NULL); }
+        workers.clear();
+        jobs.clear();
+
+        // the central directory, written once for all the entries
+        if (zipClose(w, NULL) != ZIP_OK) { success = false; }
+        return success;
+      }
+
+      static impl_archive_builder::ptr create(const std::string &archive_path, int threads)
+      {
+        impl_archive_builder::ptr b;
+        if (archive_path.empty()) { return b; }
+        if (threads <= 0) { threads = SDL_GetCPUCount(); }
+        if (threads <= 0) { threads = 1; }
+        try {
+          b.reset(new impl_archive_builder);
+          if (! b) { throw -1; }
+          b->archive_path = archive_path;
+          b->threads = threads;
+          b->mutex = SDL_CreateMutex();
+          if (! b->mutex) { throw -2; }
+          b->cond = SDL_CreateCond();
+          if (! b->cond) { throw -3; }
+        }
+        catch (...) {
+          b.reset();
+          lev::debug_print("error on archive builder creation");
+        }
+        return b;
+      }
+
+      virtual int get_count() const
+      {
+        return jobs.size();
+      }
+
+      virtual int get_threads() const
+      {
+        return threads;
+      }
+
+      static int worker_main(void *udata)
+      {
+        impl_archive_builder *b = (impl_archive_builder *)udata;
+        const int window = b->threads * WINDOW_PER_THREAD;
+        for ( ; ; )
+        {
+          int i = SDL_AtomicAdd(&b->next, 1);
+          if (i >= b->jobs.size()) { break; }
+
+          SDL_LockMutex(b->mutex);
+          while (i >= b->written + window) { SDL_CondWait(b->cond, b->mutex); }
+          SDL_UnlockMutex(b->mutex);
+
+          bool packed = b->jobs[i].pack();
+          SDL_LockMutex(b->mutex);
+          b->jobs[i].state = packed ? JOB_PACKED : JOB_FAILED;
+          SDL_CondBroadcast(b->cond);
+          SDL_UnlockMutex(b->mutex);
+        }
+        return 0;
+      }
+
+      // copying the packed stream as it is, with the checksum already computed
+      static bool write_entry(zipFile w, const job_type &job)
+      {
+        zip_fileinfo zi;
+        zi.tmz_date.tm_sec  = zi.tmz_date.tm_min = zi.tmz_date.tm_hour = 0;
+        zi.tmz_date.tm_mday = zi.tmz_date.tm_mon = zi.tmz_date.tm_year = 0;
+        zi.dosDate = 0;
+        zi.internal_fa = 0;
+        zi.external_fa = 0;
+
+        const std::string &body = (job.method == 0) ? job.data : job.packed;
+        int level = (job.method == 0) ? 0 : job.level;
+        bool large = job.data.length() > 0xffffffff;
+        int result = zipOpenNewFileInZip2_64
+                     (
+                       w, job.name.c_str(), &zi,
+                       NULL, 0, /* no local extra fields */
+                       NULL, 0, /* no global extra fields */
+                       NULL,    /* no comment */
+                       job.method, level, 1 /* raw */, large
+                     );
+        if (result != ZIP_OK) { return false; }
+
+        if (! body.empty())
+        {
+          result = zipWriteInFileInZip(w, body.data(), body.length());
+        }
+        if (zipCloseFileInZipRaw64(w, job.data.length(), job.crc) != ZIP_OK) { return false; }
+        return result == ZIP_OK;
+      }
+
+      std::string archive_path;
+      int threads;
+      SDL_mutex *mutex;
+      SDL_cond *cond;
+      std::vector<job_type> jobs;
+      std::vector<SDL_Thread *> workers;
+      SDL_atomic_t next;
+      // guarded by the mutex
+      int written;
+  };
+
+  archive_builder::ptr archive_builder::create(const std::string &archive_path, int threads)
+  {
+    return impl_archive_builder::create(archive_path, threads);
+  }
+
 }
 
 int luaopen_lev_archive(lua_State *L)
@@ -724,6 +1538,7 @@ int luaopen_lev_archive(lua_State *L)
           .def("get_size", &archive::get_uncompressed_size_current)
           .def("get_uncompressed_size", &archive::get_uncompressed_size)
           .def("get_uncompressed_size", &archive::get_uncompressed_size_current)
+          .def("open_stream", &archive::open_stream)
           .scope
           [
             def("entry_exists_direct", &archive::entry_exists_direct),
@@ -731,7 +1546,22 @@ int luaopen_lev_archive(lua_State *L)
             def("extract_direct_to", &archive::extract_direct_to),
             def("get_uncompressed_size_direct", &archive::get_uncompressed_size_direct),
             def("is_archive", &archive::is_archive),
-            def("open", &archive::open)
+            def("open", &archive::open),
+            def("open_shared", &archive::open_shared)
+          ],
+        class_<lev::archive_builder, base, base::ptr>("archive_builder")
+          .def("add_data", &archive_builder::add_data)
+          .def("add_data", &archive_builder::add_data2)
+          .def("add_file", &archive_builder::add_file)
+          .def("add_file_to", &archive_builder::add_file_to)
+          .def("add_file_to", &archive_builder::add_file_to2)
+          .def("commit", &archive_builder::commit)
+          .property("count", &archive_builder::get_count)
+          .property("threads", &archive_builder::get_threads)
+          .scope
+          [
+            def("create", &archive_builder::create),
+            def("create", &archive_builder::create1)
           ]
       ]
     ];
@@ -747,6 +1577,7 @@ int luaopen_lev_archive(lua_State *L)
     register_to(classes["archive"], "read_direct", &impl_archive::read_direct_l);
 
     arch["entry_exists"] = classes["archive"]["entry_exists_direct"];
+    arch["builder"] = classes["archive_builder"]["create"];
     arch["extract"] = classes["archive"]["extract_direct"];
     arch["extract_to"] = classes["archive"]["extract_direct_to"];
     arch["find"] = classes["archive"]["find_direct"];
@@ -754,6 +1585,7 @@ int luaopen_lev_archive(lua_State *L)
     arch["get_uncompressed_size"] = classes["archive"]["get_uncompressed_size_direct"];
     arch["is_archive"] = classes["archive"]["is_archive"];
     arch["open"] = classes["archive"]["open"];
+    arch["open_shared"] = classes["archive"]["open_shared"];
     arch["read"] = classes["archive"]["read_direct"];
 
     globals(L)["package"]["loaded"]["lev.archive"] = true;
@@ -63,6 +63,7 @@ namespace lev
         (*base_id_map)[LEV_TBASE]       = LEV_TNONE;
         {
           (*base_id_map)[LEV_TARCHIVE]  = LEV_TBASE;
+          (*base_id_map)[LEV_TARCHIVE_BUILDER] = LEV_TBASE;
           (*base_id_map)[LEV_TCOLOR]    = LEV_TBASE;
           (*base_id_map)[LEV_TDEBUGGER]  = LEV_TBASE;
 
@@ -91,8 +92,11 @@ namespace lev
           }
           (*base_id_map)[LEV_TFILEPATH]        = LEV_TBASE;
           (*base_id_map)[LEV_TFONT]            = LEV_TBASE;
+          (*base_id_map)[LEV_TLOAD_REQUEST]    = LEV_TBASE;
+          (*base_id_map)[LEV_TLOADER]          = LEV_TBASE;
           (*base_id_map)[LEV_TMIXER]           = LEV_TBASE;
           (*base_id_map)[LEV_TPOINT]           = LEV_TBASE;
+          (*base_id_map)[LEV_TPROFILER]        = LEV_TBASE;
           (*base_id_map)[LEV_TRECT]            = LEV_TBASE;
           (*base_id_map)[LEV_TSIZE]            = LEV_TBASE;
           (*base_id_map)[LEV_TSOUND]           = LEV_TBASE;
@@ -101,6 +105,7 @@ namespace lev
           (*base_id_map)[LEV_TSTOP_WATCH]      = LEV_TBASE;
           (*base_id_map)[LEV_TSYSTEM]          = LEV_TBASE;
           (*base_id_map)[LEV_TTEMP_NAME]       = LEV_TBASE;
+          (*base_id_map)[LEV_TTEXTURE_MANAGER] = LEV_TBASE;
 
           (*base_id_map)[LEV_TTIMER]           = LEV_TBASE;
           {
@@ -136,6 +141,7 @@ namespace lev
         (*type_name_map)[LEV_TNONE]       = "(none)";
         (*type_name_map)[LEV_TANIMATION]  = "lev.animation";
         (*type_name_map)[LEV_TARCHIVE]    = "lev.archive";
+        (*type_name_map)[LEV_TARCHIVE_BUILDER] = "lev.archive_builder";
         (*type_name_map)[LEV_TBASE]       = "lev.base";
         (*type_name_map)[LEV_TBITMAP]     = "lev.bitmap";
         (*type_name_map)[LEV_TCANVAS]     = "lev.canvas";
@@ -148,14 +154,18 @@ namespace lev
         (*type_name_map)[LEV_TFILEPATH]   = "lev.filepath";
         (*type_name_map)[LEV_TFONT]       = "lev.font";
         (*type_name_map)[LEV_TLAYOUT]     = "lev.layout";
+        (*type_name_map)[LEV_TLOAD_REQUEST] = "lev.load_request";
+        (*type_name_map)[LEV_TLOADER]     = "lev.loader";
         (*type_name_map)[LEV_TMAP]        = "lev.map";
         (*type_name_map)[LEV_TMEMFILE]    = "lev.memfile";
         (*type_name_map)[LEV_TMIXER]      = "lev.mixer";
         (*type_name_map)[LEV_TPOINT]      = "lev.point";
+        (*type_name_map)[LEV_TPROFILER]   = "lev.profiler";
         (*type_name_map)[LEV_TRECT]       = "lev.rect";
         (*type_name_map)[LEV_TSCREEN]     = "lev.screen";
         (*type_name_map)[LEV_TSPACER]     = "lev.spacer";
         (*type_name_map)[LEV_TTEXTURE]    = "lev.texture";
+        (*type_name_map)[LEV_TTEXTURE_MANAGER] = "lev.texture_manager";
         (*type_name_map)[LEV_TTRANSITION] = "lev.transition";
         (*type_name_map)[LEV_TSIZE]       = "lev.size";
         (*type_name_map)[LEV_TSOUND]      = "lev.sound";
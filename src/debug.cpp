@@ -20,10 +20,16 @@
 #include "lev/string.hpp"
 #include "lev/util.hpp"
 
+// libraries
+#include <SDL2/SDL.h>
+
 
 namespace lev
 {
 
+  // the debug window is drawn only from the thread which has started it
+  static SDL_threadID debugger_thread = 0;
+
   class impl_debugger : public debugger
   {
     public:
@@ -145,6 +151,7 @@ namespace lev
           dbg->lay = layout::create(w);
           if (! dbg->lay) { throw -3; }
           if (! sys->attach(dbg)) { throw -4; }
+          debugger_thread = SDL_ThreadID();
           dbg->clear();
         }
         catch (...) {
@@ -182,7 +189,9 @@ namespace lev
     char buf[9];
     strftime(buf, 9, "%H:%M:%S", t_st);
 
-    system::ptr sys = system::get();
+    // messages from worker threads (e.g. the loader) go only to the console
+    system::ptr sys;
+    if (debugger_thread == SDL_ThreadID()) { sys = system::get(); }
     if (sys && sys->get_debugger())
     {
       sys->get_debugger()->show();
@@ -23,10 +23,99 @@
 #include "lev/util.hpp"
 
 // libraries
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 namespace lev
 {
 
+  // span rasterizer helpers
+
+  // appending a span, merged into the last one when adjacent with the same coverage
+  static void add_span(std::vector<span> &spans, int x, int y, int w, unsigned char coverage)
+  {
+    if (w <= 0 || coverage == 0) { return; }
+    if (! spans.empty())
+    {
+      span &last = spans.back();
+      if (last.y == y && last.x + last.w == x && last.coverage == coverage)
+      {
+        last.w += w;
+        return;
+      }
+    }
+    span s = { x, y, w, coverage };
+    spans.push_back(s);
+  }
+
+  // narrowing [left, right] to the x where lo <= a * x + b <= hi
+  static bool clip_linear(double a, double b, double lo, double hi, double &left, double &right)
+  {
+    if (a == 0) { return lo <= b && b <= hi; }
+    double p = (lo - b) / a;
+    double q = (hi - b) / a;
+    if (p > q) { std::swap(p, q); }
+    left = std::max(left, p);
+    right = std::min(right, q);
+    return left <= right;
+  }
+
+  // x range of the row y within distance rad from the segment, false if the row misses it
+  static bool capsule_row(double x1, double y1, double x2, double y2, double rad, double y,
+                          double &left, double &right)
+  {
+    bool found = false;
+    const double ends[2][2] = { { x1, y1 }, { x2, y2 } };
+    for (int i = 0; i < 2; i++)
+    {
+      const double dy = y - ends[i][1];
+      if (dy * dy > rad * rad) { continue; }
+      const double dx = std::sqrt(rad * rad - dy * dy);
+      left = found ? std::min(left, ends[i][0] - dx) : ends[i][0] - dx;
+      right = found ? std::max(right, ends[i][0] + dx) : ends[i][0] + dx;
+      found = true;
+    }
+
+    // the band along the segment, between the perpendiculars of both ends
+    const double dx = x2 - x1;
+    const double dy = y2 - y1;
+    const double len = std::sqrt(dx * dx + dy * dy);
+    if (len == 0) { return found; }
+    double l = -1e30, r = 1e30;
+    if (clip_linear(dy, -dy * x1 - dx * (y - y1), -rad * len, rad * len, l, r) &&
+        clip_linear(dx, -dx * x1 + dy * (y - y1), 0, len * len, l, r))
+    {
+      left = found ? std::min(left, l) : l;
+      right = found ? std::max(right, r) : r;
+      found = true;
+    }
+    return found;
+  }
+
+  static double segment_distance(double x1, double y1, double x2, double y2, double x, double y)
+  {
+    const double dx = x2 - x1;
+    const double dy = y2 - y1;
+    const double len2 = dx * dx + dy * dy;
+    double t = 0;
+    if (len2 > 0)
+    {
+      t = ((x - x1) * dx + (y - y1) * dy) / len2;
+      t = std::max(0.0, std::min(1.0, t));
+    }
+    const double ex = x1 + t * dx - x;
+    const double ey = y1 + t * dy - y;
+    return std::sqrt(ex * ex + ey * ey);
+  }
+
+  static unsigned char to_coverage(double c)
+  {
+    if (c <= 0) { return 0; }
+    if (c >= 1) { return 255; }
+    return (unsigned char)(c * 255 + 0.5);
+  }
+
   spacer::ptr spacer::create(int w, int h, int descent)
   {
     spacer::ptr s;
@@ -41,10 +130,9 @@ namespace lev
     return s;
   }
 
-  bool canvas::clear_color(color::ptr c)
+  bool canvas::clear_color(const color &c)
   {
-    if (! c) { return false; }
-    return clear(c->get_r(), c->get_g(), c->get_b(), c->get_a());
+    return clear(c.get_r(), c.get_g(), c.get_b(), c.get_a());
   }
 
   int canvas::draw_l(lua_State *L)
@@ -124,38 +212,60 @@ namespace lev
     return 1;
   }
 
-  bool canvas::fill_circle(int cx, int cy, int radius, color::ptr filling)
+  bool canvas::fill_circle(int cx, int cy, int radius, const color &filling)
   {
-    if (! filling) { return false; }
-    color::ptr half = filling->clone();
-    half->set_a(half->get_a() / 2);
+    if (radius < 0) { return false; }
+    // pixels within radius - 0.5 are fully covered, the coverage fades out to radius + 0.5
+    const double inner = radius - 0.5;
+    const double outer = radius + 0.5;
+    std::vector<span> spans;
+    spans.reserve(4 * (radius + 1));
     for (int y = -radius; y <= radius; y++)
     {
-      for (int x = -radius; x <= radius; x++)
+      const double y2 = double(y) * y;
+      const int x_out = int(std::floor(std::sqrt(std::max(0.0, outer * outer - y2))));
+      int x_in = -1;
+      if (inner > 0 && y2 <= inner * inner)
       {
-        int dist2 = x * x + y * y;
-        int rad2 = radius * radius;
-        if (dist2 < rad2)
-        {
-          draw_pixel(cx + x, cy + y, *filling);
-        }
-        else if (dist2 <= rad2)
-        {
-          draw_pixel(cx + x, cy + y, *half);
-        }
+        x_in = int(std::floor(std::sqrt(inner * inner - y2)));
+      }
+
+      for (int x = -x_out; x <= -(x_in + 1); x++)
+      {
+        add_span(spans, cx + x, cy + y, 1, to_coverage(outer - std::sqrt(x * x + y2)));
+      }
+      if (x_in >= 0) { add_span(spans, cx - x_in, cy + y, 2 * x_in + 1, 255); }
+      // the center pixel of a row without full coverage is taken by the left edge
+      for (int x = (x_in >= 0 ? x_in + 1 : 1); x <= x_out; x++)
+      {
+        add_span(spans, cx + x, cy + y, 1, to_coverage(outer - std::sqrt(x * x + y2)));
       }
     }
-    return true;
+    return fill_spans(spans, filling);
   }
 
-  bool canvas::fill_rect(int offset_x, int offset_y, int w, int h, color::ptr filling)
+  bool canvas::fill_rect(int offset_x, int offset_y, int w, int h, const color &filling)
   {
-    if (! filling) { return false; }
+    if (w <= 0 || h <= 0) { return true; }
+    std::vector<span> spans;
+    spans.reserve(h);
     for (int y = 0; y < h; y++)
     {
-      for (int x = 0; x < w; x++)
+      add_span(spans, offset_x, offset_y + y, w, 255);
+    }
+    return fill_spans(spans, filling);
+  }
+
+  bool canvas::fill_spans(const std::vector<span> &spans, const color &filling)
+  {
+    for (int i = 0; i < spans.size(); i++)
+    {
+      const span &s = spans[i];
+      color c(filling);
+      c.set_a((unsigned short)filling.get_a() * s.coverage / 255);
+      for (int x = 0; x < s.w; x++)
       {
-        draw_pixel(offset_x + x, offset_y + y, *filling);
+        draw_pixel(s.x + x, s.y, c);
       }
     }
     return true;
@@ -179,68 +289,79 @@ namespace lev
 //    return bitmap_draw_mask(this, &tmp, border);
 //  }
 
-  bool canvas::stroke_line(int x1, int y1, int x2, int y2, boost::shared_ptr<color> c, int width,
+  color::ptr canvas::get_pixel(int x, int y) const
+  {
+    color c;
+    if (! get_pixel_value(x, y, c)) { return color::ptr(); }
+    return color::create(c.get_r(), c.get_g(), c.get_b(), c.get_a());
+  }
+
+  bool canvas::stroke_line(int x1, int y1, int x2, int y2, const color &c, int width,
                            const std::string &style)
   {
-    if (! c) { return false; }
-    if (x2 < x1)
-    {
-      int tmp = x1;
-      x2 = x1;
-      x1 = tmp;
-      tmp = y1;
-      y2 = y1;
-      y1 = tmp;
-    }
+    if (width < 1) { width = 1; }
     try {
-      if (style == "dot")
+      // the line is a capsule of the given width around the segment
+      const bool dotted = (style == "dot");
+      const bool horizontal = std::abs(x2 - x1) >= std::abs(y2 - y1);
+      const double inner = width / 2.0 - 0.5;
+      const double outer = width / 2.0 + 0.5;
+      const int top = int(std::floor(std::min(y1, y2) - outer));
+      const int bottom = int(std::ceil(std::max(y1, y2) + outer));
+      std::vector<span> spans;
+      spans.reserve(2 * (bottom - top + 1));
+      for (int y = top; y <= bottom; y++)
       {
-        for (int x = x1; x < x2; x+=2)
+        double out_left, out_right, in_left = 0, in_right = -1;
+        if (! capsule_row(x1, y1, x2, y2, outer, y, out_left, out_right)) { continue; }
+        if (inner <= 0 || ! capsule_row(x1, y1, x2, y2, inner, y, in_left, in_right))
         {
-          int y = y1;
-          if (x > x1)
-          {
-            y = (y2 - y1) * (x2 - x1) / (x - x1) + y1;
-          }
-          draw_pixel(x, y, *c);
+          in_left = 0;
+          in_right = -1;
         }
-      }
-      else
-      {
-        for (int x = x1; x < x2; x++)
+        const int full_begin = int(std::ceil(in_left));
+        const int full_end = int(std::floor(in_right));
+        const int end = int(std::floor(out_right));
+        for (int x = int(std::ceil(out_left)); x <= end; x++)
         {
-          int y = y1;
-          if (x > x1)
+          if (dotted)
+          {
+            if ((horizontal ? x - x1 : y - y1) & 1) { continue; }
+          }
+          else if (x == full_begin && full_begin <= full_end)
           {
-            y = (y2 - y1) * (x2 - x1) / (x - x1) + y1;
+            add_span(spans, x, y, full_end - full_begin + 1, 255);
+            x = full_end;
+            continue;
           }
-          draw_pixel(x, y, *c);
+          double dist = segment_distance(x1, y1, x2, y2, x, y);
+          add_span(spans, x, y, 1, to_coverage(outer - dist));
         }
       }
+      return fill_spans(spans, c);
     }
     catch (...) {
       return false;
     }
-    return true;
   }
 
-  bool canvas::stroke_rect(int offset_x, int offset_y, int w, int h, color::ptr border, int width)
+  bool canvas::stroke_rect(int offset_x, int offset_y, int w, int h, const color &border, int width)
   {
-    if (! border) { return false; }
+    if (w <= 0 || h <= 0) { return true; }
+    std::vector<span> spans;
+    spans.reserve(2 * h);
     for (int y = 0; y < h; y++)
     {
-      for (int x = 0; x < w; x++)
+      if (y < width || y >= h - width)
       {
-        if (0 <= x && x < width ||
-            0 <= y && y < width ||
-            w - width <= x && x < w ||
-            h - width <= y && y < h)
-        {
-          draw_pixel(offset_x + x, offset_y + y, *border);
-        }
+        add_span(spans, offset_x, offset_y + y, w, 255);
+        continue;
       }
+      add_span(spans, offset_x, offset_y + y, std::min(width, w), 255);
+      const int right = std::max(w - width, width);
+      add_span(spans, offset_x + right, offset_y + y, w - right, 255);
     }
-    return true;
+    return fill_spans(spans, border);
   }
 
 }
@@ -289,18 +410,18 @@ int luaopen_lev_draw(lua_State *L)
         .def("clear", &canvas::clear)
         .def("clear", &canvas::clear0)
         .def("clear", &canvas::clear3)
-        .def("clear", &canvas::clear_color)
+        .def("clear", &canvas::clear_color_ptr)
         .def("draw_pixel", &canvas::draw_pixel)
-        .def("fill_circle", &canvas::fill_circle)
-        .def("fill_rect", &canvas::fill_rect)
-        .def("fill_rectangle", &canvas::fill_rect)
+        .def("fill_circle", &canvas::fill_circle_ptr)
+        .def("fill_rect", &canvas::fill_rect_ptr)
+        .def("fill_rectangle", &canvas::fill_rect_ptr)
         .def("get_color", &canvas::get_pixel)
         .def("get_pixel", &canvas::get_pixel)
 //        .def("stroke_circle", &canvas::stroke_circle)
-        .def("stroke_line", &canvas::stroke_line)
-        .def("stroke_line", &canvas::stroke_line6)
-        .def("stroke_rect", &canvas::stroke_rect)
-        .def("stroke_rectangle", &canvas::stroke_rect)
+        .def("stroke_line", &canvas::stroke_line_ptr)
+        .def("stroke_line", &canvas::stroke_line6_ptr)
+        .def("stroke_rect", &canvas::stroke_rect_ptr)
+        .def("stroke_rectangle", &canvas::stroke_rect_ptr)
     ]
   ];
   object lev = globals(L)["lev"];
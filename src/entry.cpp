@@ -55,9 +55,11 @@ int luaopen_lev_std(lua_State *L)
   //  globals(L)["require"]("lev.gl");
     globals(L)["require"]("lev.image");
   //  globals(L)["require"]("lev.info");
+    globals(L)["require"]("lev.loader");
     globals(L)["require"]("lev.map");
   //  globals(L)["require"]("lev.net");
     globals(L)["require"]("lev.package");
+    globals(L)["require"]("lev.profiler");
     globals(L)["require"]("lev.screen");
     globals(L)["require"]("lev.sound");
     globals(L)["require"]("lev.string");
@@ -117,10 +119,12 @@ namespace lev
     register_to(globals(L)["package"]["preload"], "lev.map", luaopen_lev_map);
 //    register_to(globals(L)["package"]["preload"], "lev.info", luaopen_lev_info);
 //    register_to(globals(L)["package"]["preload"], "lev.input", luaopen_lev_input);
+    register_to(globals(L)["package"]["preload"], "lev.loader", luaopen_lev_loader);
 //    register_to(globals(L)["package"]["preload"], "lev.locale", luaopen_lev_locale);
 //    register_to(globals(L)["package"]["preload"], "lev.net", luaopen_lev_net);
     register_to(globals(L)["package"]["preload"], "lev.package", luaopen_lev_package);
     register_to(globals(L)["package"]["preload"], "lev.prim", luaopen_lev_prim);
+    register_to(globals(L)["package"]["preload"], "lev.profiler", luaopen_lev_profiler);
     register_to(globals(L)["package"]["preload"], "lev.screen", luaopen_lev_screen);
     register_to(globals(L)["package"]["preload"], "lev.sound", luaopen_lev_sound);
     register_to(globals(L)["package"]["preload"], "lev.std", luaopen_lev_std);
@@ -22,6 +22,9 @@
 #include "lev/util.hpp"
 
 // libraries
+#include <algorithm>
+#include <boost/shared_array.hpp>
+#include <cstring>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
@@ -82,20 +85,138 @@ int luaopen_lev_font(lua_State *L)
 namespace lev
 {
 
+  // metrics and atlas location of a cached glyph
+  struct myGlyph
+  {
+    myGlyph() : advance(0), left(0), top(0), width(0), rows(0), page(0), x(0), y(0) { }
+    int GetAscent() const { return top; }
+    int GetDescent() const { return rows - top; }
+    bool IsValid() const { return advance > 0 && rows > 0; }
+
+    int advance, left, top, width, rows;
+    int page, x, y;
+  };
+
+  struct myGlyphKey
+  {
+    myGlyphKey(int face_id, int size, unsigned long code) :
+      face_id(face_id), size(size), code(code) { }
+
+    bool operator < (const myGlyphKey &rhs) const
+    {
+      if (face_id != rhs.face_id) { return face_id < rhs.face_id; }
+      if (size != rhs.size) { return size < rhs.size; }
+      return code < rhs.code;
+    }
+
+    int face_id, size;
+    unsigned long code;
+  };
+
+  // 8-bit coverage masks of the cached glyphs, packed into pages by shelves
+  class myGlyphAtlas
+  {
+    public:
+      enum { PAGE_SIZE = 512 };
+
+      struct page_type
+      {
+        boost::shared_array<unsigned char> buf;
+        int pitch;
+      };
+
+      myGlyphAtlas() : pages(), shelf_x(0), shelf_y(0), shelf_h(0) { }
+
+      bool Clear()
+      {
+        pages.clear();
+        shelf_x = shelf_y = shelf_h = 0;
+        return true;
+      }
+
+      unsigned char *GetPixels(int page, int x, int y)
+      {
+        page_type &p = pages[page];
+        return p.buf.get() + y * p.pitch + x;
+      }
+
+      int GetPitch(int page) const
+      {
+        return pages[page].pitch;
+      }
+
+      bool Reserve(int w, int h, int *page, int *x, int *y)
+      {
+        try {
+          if (w > PAGE_SIZE || h > PAGE_SIZE)
+          {
+            // too large glyph, giving its own page
+            page_type p;
+            p.buf.reset(new unsigned char[w * h]);
+            p.pitch = w;
+            pages.push_back(p);
+            *page = pages.size() - 1;
+            *x = *y = 0;
+            // the current shelf page is no longer the last one
+            shelf_y = PAGE_SIZE;
+            return true;
+          }
+          if (shelf_x + w > PAGE_SIZE)
+          {
+            shelf_x = 0;
+            shelf_y += shelf_h;
+            shelf_h = 0;
+          }
+          if (pages.empty() || shelf_y + h > PAGE_SIZE)
+          {
+            page_type p;
+            p.buf.reset(new unsigned char[PAGE_SIZE * PAGE_SIZE]);
+            p.pitch = PAGE_SIZE;
+            pages.push_back(p);
+            shelf_x = shelf_y = shelf_h = 0;
+          }
+          *page = pages.size() - 1;
+          *x = shelf_x;
+          *y = shelf_y;
+          shelf_x += w;
+          if (h > shelf_h) { shelf_h = h; }
+          return true;
+        }
+        catch (...) {
+          return false;
+        }
+      }
+
+      std::vector<page_type> pages;
+      int shelf_x, shelf_y, shelf_h;
+  };
+
   class myFontManager
   {
     protected:
-      myFontManager() : lib(NULL) { }
+      myFontManager() : lib(NULL), face_ids(), glyphs(), atlas() { }
 
       ~myFontManager() { }
 
     public:
+      // dropping all the cached glyphs when the atlas grows over this
+      enum { MAX_ATLAS_PAGES = 16 };
 
       static myFontManager* Get()
       {
         return Init();
       }
 
+      int GetFaceID(const std::string &file, long index)
+      {
+        std::pair<std::string, long> key(file, index);
+        std::map<std::pair<std::string, long>, int>::iterator found = face_ids.find(key);
+        if (found != face_ids.end()) { return found->second; }
+        int id = face_ids.size();
+        face_ids[key] = id;
+        return id;
+      }
+
       static myFontManager* Init()
       {
         static myFontManager man;
@@ -104,13 +225,25 @@ namespace lev
         return &man;
       }
 
+      // glyph pointers are kept valid until the next call of this
+      bool Trim()
+      {
+        if (atlas.pages.size() <= MAX_ATLAS_PAGES) { return false; }
+        glyphs.clear();
+        atlas.Clear();
+        return true;
+      }
+
       FT_Library lib;
+      std::map<std::pair<std::string, long>, int> face_ids;
+      std::map<myGlyphKey, myGlyph> glyphs;
+      myGlyphAtlas atlas;
   };
 
   class myFont
   {
     protected:
-      myFont() : file(), face(NULL), size(20) { }
+      myFont() : file(), face(NULL), face_id(-1), size(20) { }
 
     public:
 
@@ -138,6 +271,7 @@ namespace lev
           if (FT_New_Face(man->lib, orig->file.c_str(),
               orig->face->face_index, &f->face)) { throw -1; }
           f->file = orig->file;
+          f->face_id = orig->face_id;
           f->SetSize(orig->size);
           return f;
         }
@@ -156,6 +290,7 @@ namespace lev
           f = new myFont;
           if (FT_New_Face(man->lib, file.c_str(), index, &f->face)) { throw -1; }
           f->file = file;
+          f->face_id = man->GetFaceID(file, index);
           f->SetSize(20);
           return f;
         }
@@ -165,6 +300,46 @@ namespace lev
         }
       }
 
+      // returns the cached glyph, rendering and caching it on the first use
+      const myGlyph* GetGlyph(unsigned long code)
+      {
+        myFontManager *man = myFontManager::Get();
+        if (! man) { return NULL; }
+        myGlyphKey key(face_id, size, code);
+        std::map<myGlyphKey, myGlyph>::iterator found = man->glyphs.find(key);
+        if (found != man->glyphs.end()) { return &found->second; }
+
+        myGlyph g;
+        if (FT_Load_Char(face, code, 0)) { return NULL; }
+        if (FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL)) { return NULL; }
+        FT_Bitmap &bmp = face->glyph->bitmap;
+        g.advance = face->glyph->advance.x >> 6;
+        if (bmp.width <= 0)
+        {
+          // blank glyph (space)
+          g.advance = size / 2;
+          g.rows = g.top = 1;
+        }
+        else
+        {
+          g.left = face->glyph->bitmap_left;
+          g.top = face->glyph->bitmap_top;
+          g.width = bmp.width;
+          g.rows = bmp.rows;
+          if (g.rows > 0)
+          {
+            if (! man->atlas.Reserve(g.width, g.rows, &g.page, &g.x, &g.y)) { return NULL; }
+            int pitch = man->atlas.GetPitch(g.page);
+            unsigned char *pixels = man->atlas.GetPixels(g.page, g.x, g.y);
+            for (int y = 0; y < g.rows; y++)
+            {
+              memcpy(pixels + y * pitch, bmp.buffer + y * bmp.pitch, g.width);
+            }
+          }
+        }
+        return &(man->glyphs[key] = g);
+      }
+
       bool SetIndex(int index)
       {
         myFontManager *man = myFontManager::Get();
@@ -173,6 +348,7 @@ namespace lev
           if (FT_New_Face(man->lib, file.c_str(), index, &f)) { throw -1; }
           Clear();
           face = f;
+          face_id = man->GetFaceID(file, index);
           return true;
         }
         catch (...) {
@@ -190,6 +366,7 @@ namespace lev
 
       std::string file;
       FT_Face face;
+      int face_id;
       int size;
   };
 
@@ -289,7 +466,7 @@ namespace lev
      }
      if (! bmp) { return bmp; }
      bmp->set_descent(bmp_fg->get_descent());
-     if (bg) { bmp->clear_color(bg); }
+     if (bg) { bmp->clear_color(*bg); }
      if (bmp_shade)
      {
        bmp->draw(bmp_shade, 1, 1);
@@ -355,40 +532,47 @@ namespace lev
     }
   }
 
+  // blends the cached glyph onto dst, as drawing its own rasterized bitmap
+  static bool draw_glyph(bitmap::ptr dst, const myGlyph &g, int x, int y, const color &fg)
+  {
+    myFontManager *man = myFontManager::Get();
+    if (! man) { return false; }
+    if (g.width <= 0) { return true; }
+    int pitch = man->atlas.GetPitch(g.page);
+    const unsigned char *pixels = man->atlas.GetPixels(g.page, g.x, g.y);
+    color c(fg);
+    unsigned char a = c.get_a();
+    // glyph pixels outside of the advance width are clipped
+    int x_begin = std::max(0, -g.left);
+    int x_end = std::min(g.width, g.advance - g.left);
+    for (int j = 0; j < g.rows; j++)
+    {
+      for (int i = x_begin; i < x_end; i++)
+      {
+        unsigned char d = pixels[j * pitch + i];
+        if (d == 0) { continue; }
+        c.set_a(a * d / 255.0);
+        dst->draw_pixel(x + g.left + i, y + j, c);
+      }
+    }
+    return true;
+  }
+
   bitmap::ptr font::rasterize_raw(unsigned long code, color::ptr fg)
   {
     bitmap::ptr r;
     try {
-      FT_Face face = cast_font(_obj)->face;
-      if (FT_Load_Char(face, code, 0)) { throw -1; }
-      if (FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL)) { throw -2; }
-
-      FT_Bitmap &bmp = face->glyph->bitmap;
-      int h = bmp.rows;
-      int w = face->glyph->advance.x >> 6;
-      int offset_x = face->glyph->bitmap_left;
-//      int offset_y = h - face->glyph->bitmap_top;
-      if (bmp.width <= 0) { return bitmap::create(get_size() / 2, 1); }
-      // printf("TOP: %d, H: %d\n", face->glyph->bitmap_top, bmp.rows)    ;
-      // printf("LEFT: %d, WIDTH: %d,  ADVANCE X: %d\n", face->glyph->    bitmap_left, bmp.width, w);
-      // printf("WIDTH: %d\n", w);
-      // al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP || ALLEGRO_NO_P    RESERVE_TEXTURE);
-
-      r = bitmap::create(w, h);
+      myFontManager *man = myFontManager::Get();
+      if (! man) { throw -1; }
+      man->Trim();
+      const myGlyph *g = cast_font(_obj)->GetGlyph(code);
+      if (! g) { throw -2; }
+      if (! g->IsValid()) { return r; }
+
+      r = bitmap::create(g->advance, g->rows);
       if (! r) { throw -3; }
-      r->set_descent(bmp.rows - face->glyph->bitmap_top);
-
-      color c(*fg);
-      unsigned char a = c.get_a();
-      for (int y = 0; y < bmp.rows; y++)
-      {
-        for (int x = 0; x < bmp.width; x++)
-        {
-          unsigned char d = bmp.buffer[y * bmp.pitch + x];
-          c.set_a(a * d / 255.0);
-          r->set_pixel(offset_x + x, y, c);
-        }
-      }
+      r->set_descent(g->GetDescent());
+      draw_glyph(r, *g, 0, 0, *fg);
     }
     catch (...) {
       r.reset();
@@ -408,31 +592,36 @@ namespace lev
      if (! fg) { return r; }
      try {
        if (str.empty()) { throw -1; }
-       std::vector<boost::shared_ptr<bitmap> > array;
+       myFontManager *man = myFontManager::Get();
+       if (! man) { throw -2; }
+       man->Trim();
+       myFont *f = cast_font(_obj);
+       std::vector<const myGlyph *> array;
+       array.reserve(str.length());
        int max_a = 0, max_d = 0, total_w = 0;
        max_a = get_size();
        max_d = get_size() * 0.2;
        int current_x = 0;
        for (int i = 0; i < str.length(); i++)
        {
-         boost::shared_ptr<bitmap> b = rasterize_raw(str.index(i), fg);
-         if (b)
+         const myGlyph *g = f->GetGlyph(str.index(i));
+         if (g && g->IsValid())
          {
-           if (b->get_ascent() > max_a) { max_a = b->get_ascent(); }
-           if (b->get_descent() > max_d) { max_d = b->get_descent(); }
-           total_w += b->get_w();
-           array.push_back(b);
+           if (g->GetAscent() > max_a) { max_a = g->GetAscent(); }
+           if (g->GetDescent() > max_d) { max_d = g->GetDescent(); }
+           total_w += g->advance;
+           array.push_back(g);
          }
        }
 //printf("MAX A: %d, MAX D: %d\n", max_a, max_d);
        r = bitmap::create(total_w, max_a + max_d);
-       if (! r) { throw -2; }
+       if (! r) { throw -3; }
        r->set_descent(max_d);
        for (int i = 0; i < array.size(); i++)
        {
-         boost::shared_ptr<bitmap> b = array[i];
-         r->draw(b, current_x, max_a - b->get_ascent());
-         current_x += b->get_w();
+         const myGlyph *g = array[i];
+         draw_glyph(r, *g, current_x, max_a - g->GetAscent(), *fg);
+         current_x += g->advance;
        }
      }
      catch (...) {
@@ -23,12 +23,51 @@
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/scoped_array.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <string>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif // _WIN32
 
 
 namespace lev
 {
 
+  // Boyer-Moore-Horspool shift table for the needle
+  static void init_skip(const unsigned char *needle, long m, long *skip)
+  {
+    for (int i = 0; i < 256; i++) { skip[i] = m; }
+    for (long i = 0; i < m - 1; i++) { skip[needle[i]] = m - 1 - i; }
+  }
+
+  // offset of the first needle in the haystack, -1 if not found
+  static long search_bmh(const unsigned char *hay, long n,
+                         const unsigned char *needle, long m, const long *skip)
+  {
+    if (m == 1)
+    {
+      const void *found = memchr(hay, needle[0], n);
+      return found ? (const unsigned char *)found - hay : -1;
+    }
+    const unsigned char last = needle[m - 1];
+    for (long i = 0; i + m <= n; )
+    {
+      const unsigned char c = hay[i + m - 1];
+      if (c == last && memcmp(hay + i, needle, m - 1) == 0) { return i; }
+      i += skip[c];
+    }
+    return -1;
+  }
+
   // file class implement
   template <typename T>
     class impl_file : public T
@@ -38,7 +77,8 @@ namespace lev
     protected:
       impl_file() :
         T(),
-        ops(NULL)
+        ops(NULL),
+        ahead(), ahead_begin(NULL), ahead_end(NULL), line()
       { }
     public:
       virtual ~impl_file()
@@ -46,14 +86,45 @@ namespace lev
         close();
       }
 
+      // bytes kept in advance for the small reads
+      enum { READ_AHEAD = 64 * 1024 };
+
       virtual bool close()
       {
+        ahead_begin = ahead_end = NULL;
         if (! ops) { return false; }
         ops->close(ops);
         ops = NULL;
         return true;
       }
 
+      // the caller keeps the ownership of ops until the adoption succeeds
+      static impl_file::ptr adopt(SDL_RWops *ops)
+      {
+        impl_file::ptr f;
+        if (! ops) { return f; }
+        try {
+          f.reset(new impl_file);
+          if (! f) { throw -1; }
+          f->wptr = f;
+          f->ops = ops;
+        }
+        catch (...) {
+          f.reset();
+          lev::debug_print("error on file adoption");
+        }
+        return f;
+      }
+
+      // giving the read-ahead bytes back, so ops is at the logical position again
+      bool discard()
+      {
+        long rest = ahead_end - ahead_begin;
+        ahead_begin = ahead_end = NULL;
+        if (rest > 0 && ops) { ops->seek(ops, -rest, SEEK_CUR); }
+        return true;
+      }
+
       virtual bool eof() const
       {
         return tell() == get_size();
@@ -69,25 +140,59 @@ namespace lev
 
       virtual void *get_ops()
       {
+        // the caller moves ops by itself
+        discard();
         return ops;
       }
 
-      virtual bool find_data(const std::string &data, int numtry = 1)
+      virtual long find_all(const std::string &data, std::vector<long> &offsets)
       {
-        if (numtry == 0) { numtry = get_size(); }
-        if (numtry < 0) { return false; }
-        std::string buf;
-        if (! read_count(buf, data.length())) { return false; }
-        for (int i = 0; i < numtry; i++)
+        if (data.empty()) { return 0; }
+        long skip[256];
+        init_skip((const unsigned char *)data.data(), data.length(), skip);
+        long pos = tell();
+        long count = 0;
+        for (long found; (found = search(data, LONG_MAX, skip, pos)) >= 0; count++)
         {
-//printf("POS: %d\n", (int)tell());
-          if (buf == data) { return true; }
-          unsigned char byte;
-          if (read(&byte, 1, 1) == 0) { return false; }
-          buf.replace(0, 1, "");
-          buf.append(1, byte);
+          offsets.push_back(found);
+        }
+        return count;
+      }
+
+      static int find_all_l(lua_State *L)
+      {
+        using namespace luabind;
+
+        try {
+          luaL_checktype(L, 1, LUA_TUSERDATA);
+          T *f = object_cast<T *>(object(from_stack(L, 1)));
+          if (! f) { throw -1; }
+          size_t len = 0;
+          const char *data = luaL_checklstring(L, 2, &len);
+          std::vector<long> offsets;
+          f->find_all(std::string(data, len), offsets);
+          lua_createtable(L, offsets.size(), 0);
+          for (int i = 0; i < offsets.size(); i++)
+          {
+            lua_pushnumber(L, offsets[i]);
+            lua_rawseti(L, -2, i + 1);
+          }
+        }
+        catch (...) {
+          lev::debug_print("error on file searching");
+          lua_pushnil(L);
         }
-        return false;
+        return 1;
+      }
+
+      virtual bool find_data(const std::string &data, int numtry = 1)
+      {
+        if (numtry == 0) { numtry = get_size(); }
+        if (numtry < 0 || data.empty()) { return false; }
+        long skip[256];
+        init_skip((const unsigned char *)data.data(), data.length(), skip);
+        long pos = tell();
+        return search(data, numtry, skip, pos) >= 0;
       }
 
       virtual long get_size() const
@@ -117,10 +222,60 @@ namespace lev
         return f;
       }
 
+      virtual bool peek(std::string &content, int count)
+      {
+        if (count <= 0) { return false; }
+        refill(count);
+        if (ahead_end == ahead_begin) { return false; }
+        content.assign((const char *)ahead_begin,
+                       std::min<long>(count, ahead_end - ahead_begin));
+        return true;
+      }
+
+      virtual bool push_line(lua_State *L)
+      {
+        if (! refill(1)) { return false; }
+        const unsigned char *found =
+          (const unsigned char *)memchr(ahead_begin, '\n', ahead_end - ahead_begin);
+        if (found)
+        {
+          // pushing straight from the read-ahead bytes
+          const unsigned char *end = found;
+          if (end > ahead_begin && end[-1] == '\r') { end--; }
+          lua_pushlstring(L, (const char *)ahead_begin, end - ahead_begin);
+          ahead_begin = found + 1;
+          return true;
+        }
+        // the line continues after the buffered bytes
+        if (! read_line(line)) { return false; }
+        lua_pushlstring(L, line.data(), line.length());
+        return true;
+      }
+
       virtual size_t read(void *buf, size_t size, size_t maxnum)
       {
-        if (! ops) { return 0; }
-        return ops->read(ops, buf, size, maxnum);
+        if (! ops || size == 0) { return 0; }
+        unsigned char *dst = (unsigned char *)buf;
+        size_t total = size * maxnum;
+        size_t done = std::min<size_t>(total, ahead_end - ahead_begin);
+        if (done > 0)
+        {
+          memcpy(dst, ahead_begin, done);
+          ahead_begin += done;
+        }
+        if (done < total)
+        {
+          // large reads go to ops directly, small ones through the read-ahead bytes
+          if (total - done >= READ_AHEAD) { done += ops->read(ops, dst + done, 1, total - done); }
+          else if (refill(1))
+          {
+            size_t n = std::min<size_t>(total - done, ahead_end - ahead_begin);
+            memcpy(dst + done, ahead_begin, n);
+            ahead_begin += n;
+            done += n;
+          }
+        }
+        return done / size;
       }
 
       virtual bool read_all(std::string &content)
@@ -141,43 +296,80 @@ namespace lev
 
       virtual unsigned short read_le16()
       {
-        unsigned char buf[2];
-        read(buf, 1, 2);
-        return buf[0] << 8 | buf[1];
+        unsigned short value = 0;
+        read_le16_array(&value, 1);
+        return value;
+      }
+
+      virtual int read_le16_array(unsigned short *values, int count)
+      {
+        int done = 0;
+        while (done < count && refill(2))
+        {
+          int n = std::min<long>(count - done, (ahead_end - ahead_begin) / 2);
+          for (int i = 0; i < n; i++, ahead_begin += 2)
+          {
+            values[done + i] = ahead_begin[0] | ahead_begin[1] << 8;
+          }
+          done += n;
+        }
+        return done;
       }
 
       virtual unsigned long read_le32()
       {
-        unsigned char buf[4];
-        read(buf, 1, 4);
-        return buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+        unsigned long value = 0;
+        read_le32_array(&value, 1);
+        return value;
       }
 
-      virtual bool read_line(std::string &content)
+      virtual int read_le32_array(unsigned long *values, int count)
       {
-        if (! ops) { return false; }
-        const int buf_size = 4096;
-        unsigned char buf[buf_size + 1];
-        int i = 0;
-        while ( true )
+        int done = 0;
+        while (done < count && refill(4))
         {
-          if (ops->read(ops, &buf[i], 1, 1) == 0)
+          int n = std::min<long>(count - done, (ahead_end - ahead_begin) / 4);
+          for (int i = 0; i < n; i++, ahead_begin += 4)
           {
-            if (i == 0) { return false; }
-            else { return true; }
+            values[done + i] = (unsigned long)ahead_begin[0]       |
+                               (unsigned long)ahead_begin[1] <<  8 |
+                               (unsigned long)ahead_begin[2] << 16 |
+                               (unsigned long)ahead_begin[3] << 24;
           }
-          if (buf[i] == '\n')
+          done += n;
+        }
+        return done;
+      }
+
+      virtual bool read_line(std::string &content)
+      {
+        if (! read_until(content, '\n')) { return false; }
+        if (! content.empty() && content[content.length() - 1] == '\r')
+        {
+          content.erase(content.length() - 1);
+        }
+        return true;
+      }
+
+      virtual bool read_until(std::string &content, char delim)
+      {
+        bool readed = false;
+        content.clear();
+        while (refill(1))
+        {
+          readed = true;
+          const unsigned char *found =
+            (const unsigned char *)memchr(ahead_begin, delim, ahead_end - ahead_begin);
+          if (found)
           {
-            buf[i] = '\0';
-            content.assign((const char *)buf, 0, i + 1);
+            content.append((const char *)ahead_begin, found - ahead_begin);
+            ahead_begin = found + 1;
             return true;
           }
-          if (buf[i] != '\r')
-          {
-            i++;
-            if (i == buf_size) { return true; }
-          }
+          content.append((const char *)ahead_begin, ahead_end - ahead_begin);
+          ahead_begin = ahead_end;
         }
+        return readed;
       }
 
       static int read_l(lua_State *L)
@@ -195,18 +387,16 @@ namespace lev
           if (t["lua.string1"]) { format_str = object_cast<const char *>( t["lua.string1"]); }
           if (t["lua.number1"]) { num = object_cast<int>(t["lua.number1"]); }
 
-          if (! format_str && num < 0)
+          if (! format_str && num >= 0)
           {
-            std::string line;
-            if (! f->read_line(line)) { lua_pushnil(L); }
-            else { lua_pushstring(L, line.c_str()); }
+            std::string data;
+            if (! f->read_count(data, num)) { lua_pushnil(L); }
+            else { lua_pushlstring(L, data.c_str(), data.length()); }
             return 1;
           }
-          else if (strcmp(format_str, "*l") == 0)
+          else if (! format_str || strcmp(format_str, "*l") == 0)
           {
-            std::string line;
-            if (! f->read_line(line)) { lua_pushnil(L); }
-            else { lua_pushstring(L, line.c_str()); }
+            if (! f->push_line(L)) { lua_pushnil(L); }
             return 1;
           }
           else if (strcmp(format_str, "*a") == 0)
@@ -242,13 +432,14 @@ namespace lev
       virtual long seek(long pos)
       {
         if (! ops) { return -1; }
+        discard();
         return ops->seek(ops, pos, SEEK_SET);
       }
 
       virtual long tell() const
       {
         if (! ops) { return -1; }
-        return ops->seek(ops, 0, SEEK_CUR);
+        return ops->seek(ops, 0, SEEK_CUR) - (ahead_end - ahead_begin);
       }
 
       virtual file::ptr to_file()
@@ -259,13 +450,114 @@ namespace lev
       virtual bool write(const std::string &data)
       {
         if (! ops) { return false; }
+        discard();
         return ops->write(ops, data.c_str(), 1, data.length());
       }
 
+    protected:
+
+      // making at least want bytes available from ahead_begin if the file has them
+      bool refill(int want)
+      {
+        long rest = ahead_end - ahead_begin;
+        if (rest >= want) { return true; }
+        if (! ops) { return false; }
+
+        const unsigned char *data = this->get_data();
+        if (data)
+        {
+          // memory backed files are read in place, up to the end at once
+          long pos = ops->seek(ops, 0, SEEK_CUR);
+          long size = get_size();
+          if (pos >= size) { return false; }
+          ahead_begin = data + pos - rest;
+          ahead_end = data + size;
+          ops->seek(ops, size, SEEK_SET);
+          return ahead_end - ahead_begin >= want;
+        }
+
+        // rebasing the pending bytes before growing, which may move the storage
+        if (rest > 0) { memmove(&ahead[0], ahead_begin, rest); }
+        if (ahead.size() < (size_t)want) { ahead.resize(std::max<int>(want, READ_AHEAD)); }
+        while (rest < want)
+        {
+          size_t n = ops->read(ops, &ahead[rest], 1, ahead.size() - rest);
+          if (n == 0) { break; }
+          rest += n;
+        }
+        ahead_begin = &ahead[0];
+        ahead_end = ahead_begin + rest;
+        return rest >= want;
+      }
+
+      // consuming through the first match starting within tries positions,
+      // pos follows the logical position, returns the match offset or -1
+      long search(const std::string &needle, long tries, const long *skip, long &pos)
+      {
+        const unsigned char *pattern = (const unsigned char *)needle.data();
+        const long m = needle.length();
+        // keeping m - 1 bytes over the chunk boundary, for the matches across it
+        while (tries > 0 && refill(m))
+        {
+          const long starts = std::min<long>(ahead_end - ahead_begin - m + 1, tries);
+          const long found = search_bmh(ahead_begin, starts + m - 1, pattern, m, skip);
+          if (found >= 0)
+          {
+            ahead_begin += found + m;
+            pos += found + m;
+            return pos - m;
+          }
+          ahead_begin += starts;
+          pos += starts;
+          tries -= starts;
+        }
+        return -1;
+      }
+
+    public:
       SDL_RWops *ops;
       boost::weak_ptr<impl_file> wptr;
+    protected:
+      // unread bytes are [ahead_begin, ahead_end), in ahead or in the memory of the file
+      std::vector<unsigned char> ahead;
+      const unsigned char *ahead_begin;
+      const unsigned char *ahead_end;
+      std::string line;
   };
 
+  file::ptr file::adopt_ops(void *ops)
+  {
+    return impl_file<file>::adopt((SDL_RWops *)ops);
+  }
+
+  static int lines_next_l(lua_State *L)
+  {
+    // upvalue 1 keeps the file alive, upvalue 2 is the raw pointer
+    file *f = (file *)lua_touserdata(L, lua_upvalueindex(2));
+    if (! f || ! f->push_line(L)) { lua_pushnil(L); }
+    return 1;
+  }
+
+  int file::lines_l(lua_State *L)
+  {
+    using namespace luabind;
+
+    try {
+      luaL_checktype(L, 1, LUA_TUSERDATA);
+      file *f = object_cast<file *>(object(from_stack(L, 1)));
+      if (! f) { throw -1; }
+      lua_pushvalue(L, 1);
+      lua_pushlightuserdata(L, f);
+      lua_pushcclosure(L, lines_next_l, 2);
+      return 1;
+    }
+    catch (...) {
+      lev::debug_print("error on file line iteration");
+      lua_pushnil(L);
+      return 1;
+    }
+  }
+
   file::ptr file::open(const std::string &path, const std::string &mode)
   {
     return impl_file<file>::open(path, mode);
@@ -289,9 +581,15 @@ namespace lev
         return buffer;
       }
 
+      virtual const unsigned char *get_data()
+      {
+        return buffer;
+      }
+
       virtual bool close()
       {
-        if (! ops)
+        ahead_begin = ahead_end = NULL;
+        if (ops)
         {
           ops->close(ops);
           ops = NULL;
@@ -332,6 +630,169 @@ namespace lev
     return impl_memfile::create(size);
   }
 
+  // memory mapped file class implementation
+  class impl_mapfile : public impl_file<file>
+  {
+    public:
+      typedef boost::shared_ptr<impl_mapfile> ptr;
+    protected:
+      impl_mapfile() :
+        impl_file<file>(),
+#ifdef _WIN32
+        file_handle(INVALID_HANDLE_VALUE), map_handle(NULL),
+#endif // _WIN32
+        data(NULL), size(0)
+      { }
+    public:
+      virtual ~impl_mapfile()
+      {
+        close();
+      }
+
+      virtual bool close()
+      {
+        impl_file<file>::close();
+        if (! data) { return false; }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(map_handle);
+        CloseHandle(file_handle);
+        map_handle = NULL;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        munmap(data, size);
+#endif // _WIN32
+        data = NULL;
+        size = 0;
+        return true;
+      }
+
+      virtual const unsigned char *get_data()
+      {
+        return (const unsigned char *)data;
+      }
+
+      virtual long get_size() const
+      {
+        if (! ops) { return -1; }
+        return size;
+      }
+
+      static impl_mapfile::ptr open(const std::string &path)
+      {
+        impl_mapfile::ptr f;
+        try {
+          f.reset(new impl_mapfile);
+          if (! f) { throw -1; }
+          f->wptr = f;
+#ifdef _WIN32
+          f->file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+          if (f->file_handle == INVALID_HANDLE_VALUE) { throw -2; }
+          LARGE_INTEGER file_size;
+          if (! GetFileSizeEx(f->file_handle, &file_size)) { throw -3; }
+          // empty files can't be mapped
+          if (file_size.QuadPart <= 0) { throw -3; }
+          f->map_handle = CreateFileMappingA(f->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+          if (! f->map_handle) { throw -4; }
+          f->data = MapViewOfFile(f->map_handle, FILE_MAP_READ, 0, 0, 0);
+          if (! f->data) { throw -4; }
+          f->size = (long)file_size.QuadPart;
+#else
+          int fd = ::open(path.c_str(), O_RDONLY);
+          if (fd < 0) { throw -2; }
+          struct stat st;
+          // empty files can't be mapped
+          if (fstat(fd, &st) != 0 || st.st_size <= 0)
+          {
+            ::close(fd);
+            throw -3;
+          }
+          void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          // the mapping stays valid after closing the descriptor
+          ::close(fd);
+          if (addr == MAP_FAILED) { throw -4; }
+          f->data = addr;
+          f->size = st.st_size;
+#endif // _WIN32
+          f->ops = SDL_RWFromConstMem(f->data, f->size);
+          if (! f->ops) { throw -5; }
+        }
+        catch (...) {
+          f.reset();
+        }
+        return f;
+      }
+
+#ifdef _WIN32
+      HANDLE file_handle;
+      HANDLE map_handle;
+#endif // _WIN32
+      void *data;
+      long size;
+  };
+
+  file::ptr file::open_mapped(const std::string &path)
+  {
+    return impl_mapfile::open(path);
+  }
+
+  // part of the memory of another file, kept alive by the view
+  class impl_viewfile : public impl_file<file>
+  {
+    public:
+      typedef boost::shared_ptr<impl_viewfile> ptr;
+    protected:
+      impl_viewfile() :
+        impl_file<file>(),
+        src(), data(NULL), size(0)
+      { }
+    public:
+      virtual ~impl_viewfile() { }
+
+      virtual const unsigned char *get_data()
+      {
+        return data;
+      }
+
+      virtual long get_size() const
+      {
+        if (! ops) { return -1; }
+        return size;
+      }
+
+      static impl_viewfile::ptr open(file::ptr src, long offset, long size)
+      {
+        impl_viewfile::ptr f;
+        if (! src || ! src->get_data()) { return f; }
+        if (offset < 0 || size <= 0 || offset + size > src->get_size()) { return f; }
+        try {
+          f.reset(new impl_viewfile);
+          if (! f) { throw -1; }
+          f->wptr = f;
+          f->src = src;
+          f->data = src->get_data() + offset;
+          f->size = size;
+          f->ops = SDL_RWFromConstMem(f->data, size);
+          if (! f->ops) { throw -2; }
+        }
+        catch (...) {
+          f.reset();
+          lev::debug_print("error on file view opening");
+        }
+        return f;
+      }
+
+      file::ptr src;
+      const unsigned char *data;
+      long size;
+  };
+
+  file::ptr file::open_view(file::ptr src, long offset, long size)
+  {
+    return impl_viewfile::open(src, offset, size);
+  }
+
 
   temp_name::temp_name() : path_str() { }
 
@@ -881,6 +1342,8 @@ int luaopen_lev_fs(lua_State *L)
         .def("find", &file::find_data)
         .property("pos", &file::tell, &file::seek)
         .property("postion", &file::tell, &file::seek)
+        .def("read_le16", &file::read_le16)
+        .def("read_le32", &file::read_le32)
         .property("size", &file::get_size)
         .def("save", &file::save)
         .def("seek", &file::seek)
@@ -889,7 +1352,8 @@ int luaopen_lev_fs(lua_State *L)
         .scope
         [
           def("open", &file::open),
-          def("open", &file::open1)
+          def("open", &file::open1),
+          def("open_mapped", &file::open_mapped)
         ],
       class_<memfile, file, file::ptr>("memfile")
         .scope
@@ -971,7 +1435,11 @@ int luaopen_lev_fs(lua_State *L)
   object classes = lev["classes"];
   object fs = lev["fs"];
 
+  register_to(classes["file"], "find_all", &impl_file<file>::find_all_l);
+  register_to(classes["file"], "lines", &file::lines_l);
   register_to(classes["file"], "read", &impl_file<file>::read_l);
+  register_to(classes["memfile"], "find_all", &impl_file<memfile>::find_all_l);
+  register_to(classes["memfile"], "lines", &file::lines_l);
   register_to(classes["memfile"], "read", &impl_file<memfile>::read_l);
   register_to(classes["filepath"], "create_temp", &impl_filepath::create_temp_l);
 //  register_to(classes["fs"], "open", &fs::open_l);
@@ -997,6 +1465,7 @@ int luaopen_lev_fs(lua_State *L)
   fs["memfile"] = classes["memfile"]["create"];
   fs["mkdir"] = classes["fs"]["mkdir"];
   fs["open"] = classes["file"]["open"];
+  fs["open_mapped"] = classes["file"]["open_mapped"];
   fs["path"] = classes["filepath"]["create"];
   fs["pwd"] = classes["fs"]["get_current_directory"];
   fs["remove"] = classes["fs"]["remove"];
@@ -19,6 +19,7 @@
 #include "lev/entry.hpp"
 #include "lev/font.hpp"
 #include "lev/fs.hpp"
+#include "lev/profiler.hpp"
 #include "lev/util.hpp"
 #include "lev/screen.hpp"
 #include "lev/system.hpp"
@@ -26,11 +27,18 @@
 //#include "resource/levana.xpm"
 
 // libraries
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <GL/glu.h>
 #include <luabind/adopt_policy.hpp>
 #include <luabind/luabind.hpp>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  #include <immintrin.h>
+#endif
 
 #include "stb_image.c"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -118,6 +126,236 @@ namespace lev
     return true;
   }
 
+  // row span blending
+  //
+  // every kernel below must give the same result as blend_pixel() applied
+  // pixel by pixel. the general case of blend_pixel() is:
+  //
+  //   base  = dst_a * (255 - src_a) / 255
+  //   out_a = src_a + base
+  //   out_c = (src_c * src_a + dst_c * base) / out_a
+  //
+  // which also covers the "dst_a == 0", "src_a == 255" and "dst_a == 255"
+  // branches exactly, so only "src_a == 0" has to be masked out. the
+  // numerators never exceed 255 * 255 and the denominators never exceed 255,
+  // so a correctly rounded float division truncated toward zero equals the
+  // integer division.
+
+  typedef void (*blend_span_func)(unsigned char *dst, const unsigned char *src, int n);
+
+  static void blend_span_scalar(unsigned char *dst, const unsigned char *src, int n)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      blend_pixel(dst, src);
+      dst += 4;
+      src += 4;
+    }
+  }
+
+  static bool span_is_opaque(const unsigned char *src, int n)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      if (src[4 * i + 3] != 255) { return false; }
+    }
+    return true;
+  }
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+  __attribute__((target("sse2")))
+  static __m128i blend_pixel_sse2(__m128i s, __m128i d, __m128 lane_a)
+  {
+    // s, d: one pixel as 4 x int32 (r, g, b, a)
+    const __m128 c255 = _mm_set1_ps(255.0f);
+    __m128 fs = _mm_cvtepi32_ps(s);
+    __m128 fd = _mm_cvtepi32_ps(d);
+    __m128 sa = _mm_shuffle_ps(fs, fs, 0xFF);
+    __m128 da = _mm_shuffle_ps(fd, fd, 0xFF);
+    __m128 base = _mm_cvtepi32_ps(_mm_cvttps_epi32(
+                    _mm_div_ps(_mm_mul_ps(da, _mm_sub_ps(c255, sa)), c255)));
+    __m128 out_a = _mm_add_ps(sa, base);
+    __m128 out_c = _mm_cvtepi32_ps(_mm_cvttps_epi32(
+                     _mm_div_ps(_mm_add_ps(_mm_mul_ps(fs, sa), _mm_mul_ps(fd, base)), out_a)));
+    return _mm_cvttps_epi32(_mm_or_ps(_mm_andnot_ps(lane_a, out_c), _mm_and_ps(lane_a, out_a)));
+  }
+
+  __attribute__((target("sse2")))
+  static void blend_span_sse2(unsigned char *dst, const unsigned char *src, int n)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128 lane_a = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+      __m128i s_a = _mm_and_si128(s, alpha_mask);
+      int clear = _mm_movemask_epi8(_mm_cmpeq_epi32(s_a, zero));
+      if (clear == 0xFFFF) { continue; }
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(s_a, alpha_mask)) == 0xFFFF)
+      {
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), s);
+        continue;
+      }
+      __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+      __m128i d_a = _mm_and_si128(d, alpha_mask);
+      __m128i result;
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(d_a, alpha_mask)) == 0xFFFF)
+      {
+        // destination opaque: (s * a + d * (255 - a)) / 255 in 16 bits,
+        // x / 255 == (x + 1 + (x >> 8)) >> 8 for x <= 255 * 255
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        __m128i x_lo = _mm_add_epi16(_mm_mullo_epi16(s_lo, a_lo),
+                                     _mm_mullo_epi16(d_lo, _mm_sub_epi16(c255, a_lo)));
+        __m128i x_hi = _mm_add_epi16(_mm_mullo_epi16(s_hi, a_hi),
+                                     _mm_mullo_epi16(d_hi, _mm_sub_epi16(c255, a_hi)));
+        x_lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x_lo, one), _mm_srli_epi16(x_lo, 8)), 8);
+        x_hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x_hi, one), _mm_srli_epi16(x_hi, 8)), 8);
+        result = _mm_or_si128(_mm_packus_epi16(x_lo, x_hi), alpha_mask);
+      }
+      else
+      {
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+        __m128i p0 = blend_pixel_sse2(_mm_unpacklo_epi16(s_lo, zero),
+                                      _mm_unpacklo_epi16(d_lo, zero), lane_a);
+        __m128i p1 = blend_pixel_sse2(_mm_unpackhi_epi16(s_lo, zero),
+                                      _mm_unpackhi_epi16(d_lo, zero), lane_a);
+        __m128i p2 = blend_pixel_sse2(_mm_unpacklo_epi16(s_hi, zero),
+                                      _mm_unpacklo_epi16(d_hi, zero), lane_a);
+        __m128i p3 = blend_pixel_sse2(_mm_unpackhi_epi16(s_hi, zero),
+                                      _mm_unpackhi_epi16(d_hi, zero), lane_a);
+        result = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        // fully transparent source pixels leave the destination untouched
+        __m128i keep = _mm_cmpeq_epi32(s_a, zero);
+        result = _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, result));
+      }
+      _mm_storeu_si128((__m128i *)(dst + 4 * i), result);
+    }
+    blend_span_scalar(dst + 4 * i, src + 4 * i, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static __m256i blend_pixels_avx2(__m256i s, __m256i d, __m256 lane_a)
+  {
+    // s, d: two pixels as 8 x int32 (r, g, b, a, r, g, b, a)
+    const __m256 c255 = _mm256_set1_ps(255.0f);
+    __m256 fs = _mm256_cvtepi32_ps(s);
+    __m256 fd = _mm256_cvtepi32_ps(d);
+    __m256 sa = _mm256_shuffle_ps(fs, fs, 0xFF);
+    __m256 da = _mm256_shuffle_ps(fd, fd, 0xFF);
+    __m256 base = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(
+                    _mm256_div_ps(_mm256_mul_ps(da, _mm256_sub_ps(c255, sa)), c255)));
+    __m256 out_a = _mm256_add_ps(sa, base);
+    __m256 out_c = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(
+                     _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(fs, sa),
+                                                 _mm256_mul_ps(fd, base)), out_a)));
+    return _mm256_cvttps_epi32(_mm256_blendv_ps(out_c, out_a, lane_a));
+  }
+
+  __attribute__((target("avx2")))
+  static void blend_span_avx2(unsigned char *dst, const unsigned char *src, int n)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_mask = _mm256_set1_epi32(0xFF000000);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256 lane_a = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+      __m256i s_a = _mm256_and_si256(s, alpha_mask);
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s_a, zero)) == -1) { continue; }
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s_a, alpha_mask)) == -1)
+      {
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), s);
+        continue;
+      }
+      __m256i d = _mm256_loadu_si256((const __m256i *)(dst + 4 * i));
+      __m256i d_a = _mm256_and_si256(d, alpha_mask);
+      __m256i result;
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(d_a, alpha_mask)) == -1)
+      {
+        // destination opaque, same arithmetic as blend_span_sse2()
+        __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+        __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+        __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+        __m256i a_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        __m256i a_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        __m256i x_lo = _mm256_add_epi16(_mm256_mullo_epi16(s_lo, a_lo),
+                                        _mm256_mullo_epi16(d_lo, _mm256_sub_epi16(c255, a_lo)));
+        __m256i x_hi = _mm256_add_epi16(_mm256_mullo_epi16(s_hi, a_hi),
+                                        _mm256_mullo_epi16(d_hi, _mm256_sub_epi16(c255, a_hi)));
+        x_lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x_lo, one),
+                                                  _mm256_srli_epi16(x_lo, 8)), 8);
+        x_hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x_hi, one),
+                                                  _mm256_srli_epi16(x_hi, 8)), 8);
+        result = _mm256_or_si256(_mm256_packus_epi16(x_lo, x_hi), alpha_mask);
+      }
+      else
+      {
+        const __m128i *s128 = (const __m128i *)(src + 4 * i);
+        const __m128i *d128 = (const __m128i *)(dst + 4 * i);
+        __m128i s0 = _mm_loadu_si128(s128);
+        __m128i s1 = _mm_loadu_si128(s128 + 1);
+        __m128i d0 = _mm_loadu_si128(d128);
+        __m128i d1 = _mm_loadu_si128(d128 + 1);
+        __m256i p01 = blend_pixels_avx2(_mm256_cvtepu8_epi32(s0),
+                                        _mm256_cvtepu8_epi32(d0), lane_a);
+        __m256i p23 = blend_pixels_avx2(_mm256_cvtepu8_epi32(_mm_srli_si128(s0, 8)),
+                                        _mm256_cvtepu8_epi32(_mm_srli_si128(d0, 8)), lane_a);
+        __m256i p45 = blend_pixels_avx2(_mm256_cvtepu8_epi32(s1),
+                                        _mm256_cvtepu8_epi32(d1), lane_a);
+        __m256i p67 = blend_pixels_avx2(_mm256_cvtepu8_epi32(_mm_srli_si128(s1, 8)),
+                                        _mm256_cvtepu8_epi32(_mm_srli_si128(d1, 8)), lane_a);
+        // packing works per 128-bit lane, so restore the pixel order afterward
+        result = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+        result = _mm256_permutevar8x32_epi32(result, order);
+        __m256i keep = _mm256_cmpeq_epi32(s_a, zero);
+        result = _mm256_blendv_epi8(result, d, keep);
+      }
+      _mm256_storeu_si256((__m256i *)(dst + 4 * i), result);
+    }
+    blend_span_sse2(dst + 4 * i, src + 4 * i, n - i);
+  }
+
+  static blend_span_func select_blend_span()
+  {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return blend_span_avx2; }
+    if (__builtin_cpu_supports("sse2")) { return blend_span_sse2; }
+    return blend_span_scalar;
+  }
+
+#else
+
+  static blend_span_func select_blend_span()
+  {
+    return blend_span_scalar;
+  }
+
+#endif // __GNUC__ && (__i386__ || __x86_64__)
+
+  static void blend_span(unsigned char *dst, const unsigned char *src, int n)
+  {
+    static blend_span_func func = select_blend_span();
+    func(dst, src, n);
+  }
+
   class impl_bitmap : public bitmap
   {
     public:
@@ -125,14 +363,44 @@ namespace lev
     protected:
       impl_bitmap(int w, int h) :
         bitmap(),
-        w(w), h(h), descent(0),
-        tex()
+        w(w), h(h), descent(0), buf(NULL), deleter(NULL),
+        tex(), stamp(0), row_stamps(h, 0),
+        dirty_left(0), dirty_top(0), dirty_right(0), dirty_bottom(0)
+      { }
+
+      // ownership transfer of an already filled buffer
+      impl_bitmap(int w, int h, unsigned char *buf, void (*deleter)(void *)) :
+        bitmap(),
+        w(w), h(h), descent(0), buf(buf), deleter(deleter),
+        tex(), stamp(0), row_stamps(h, 0),
+        dirty_left(0), dirty_top(0), dirty_right(0), dirty_bottom(0)
       { }
     public:
 
       virtual ~impl_bitmap()
       {
-        if (buf) { delete [] buf; }
+        if (! buf) { return; }
+        if (deleter) { deleter(buf); }
+        else { delete [] buf; }
+      }
+
+      static impl_bitmap::ptr adopt(int w, int h, unsigned char *buffer,
+                                    void (*deleter)(void *))
+      {
+        impl_bitmap::ptr bmp;
+        if (w <= 0 || h <= 0 || ! buffer) { return bmp; }
+        try {
+          bmp.reset(new impl_bitmap(w, h, buffer, deleter));
+          if (! bmp) { throw -1; }
+          bmp->wptr = bmp;
+        }
+        catch (...) {
+          // the buffer is owned by the caller until the adoption succeeds
+          if (bmp) { bmp->buf = NULL; }
+          bmp.reset();
+          lev::debug_print("error on bitmap buffer adoption");
+        }
+        return bmp;
       }
 
       virtual bool blit(int dst_x, int dst_y, bitmap::ptr src,
@@ -148,23 +416,35 @@ namespace lev
         int src_w = src->get_w();
         if (w < 0) { w = src_w; }
         if (h < 0) { h = src_h; }
-        for (int y = 0; y < h; y++)
+
+        // clipping the rectangle once, instead of checking every pixel
+        int x_begin = std::max(0, std::max(-src_x, -dst_x));
+        int x_end   = std::min(w, std::min(src_w - src_x, dst_w - dst_x));
+        int y_begin = std::max(0, std::max(-src_y, -dst_y));
+        int y_end   = std::min(h, std::min(src_h - src_y, dst_h - dst_y));
+        if (x_begin >= x_end || y_begin >= y_end) { return true; }
+
+        int len = x_end - x_begin;
+        // blitting onto itself, rows may overlap
+        bool self = (src_buf == dst_buf);
+        for (int y = y_begin; y < y_end; y++)
         {
-          for (int x = 0; x < w; x++)
+          const unsigned char *src_row = &src_buf[4 * ((src_y + y) * src_w + src_x + x_begin)];
+          unsigned char *dst_row = &dst_buf[4 * ((dst_y + y) * dst_w + dst_x + x_begin)];
+          if (span_is_opaque(src_row, len))
+          {
+            memmove(dst_row, src_row, 4 * len);
+          }
+          else if (self)
+          {
+            blend_span_scalar(dst_row, src_row, len);
+          }
+          else
           {
-            int real_src_x = src_x + x;
-            int real_src_y = src_y + y;
-            if (real_src_x < 0 || real_src_x >= src_w || real_src_y < 0 || real_src_y >= src_h)
-            { continue; }
-            int real_dst_x = dst_x + x;
-            int real_dst_y = dst_y + y;
-            if (real_dst_x < 0 || real_dst_x >= dst_w || real_dst_y < 0 || real_dst_y >= dst_h)
-            { continue; }
-            const unsigned char *src_pixel = &src_buf[4 * (real_src_y * src_w + real_src_x)];
-            blend_pixel(&dst_buf[4 * (real_dst_y * dst_w + real_dst_x)], src_pixel);
+            blend_span(dst_row, src_row, len);
           }
         }
-        return on_change();
+        return on_change(dst_y + y_begin, dst_y + y_end, dst_x + x_begin, dst_x + x_end);
       }
 
       virtual bool clear(unsigned char r = 0, unsigned char g = 0,
@@ -237,8 +517,8 @@ namespace lev
       virtual bool draw(drawable::ptr src, int x, int y, unsigned char alpha)
       {
         if (! src) { return false; }
-        src->draw_on(to_canvas(), x, y, alpha);
-        return on_change();
+        // modified regions are already marked by the drawing methods
+        return src->draw_on(to_canvas(), x, y, alpha);
       }
 
       virtual bool draw_on(canvas::ptr dst, int offset_x, int offset_y, unsigned char alpha)
@@ -253,7 +533,60 @@ namespace lev
         unsigned char *buf = get_buffer();
         unsigned char *pixel = &buf[4 * (y * get_w() + x)];
         blend_pixel(pixel, c);
-        return on_change();
+        return on_change(y, y + 1, x, x + 1);
+      }
+
+      virtual bool fill_spans(const std::vector<span> &spans, const color &filling)
+      {
+        // translucent spans are blended from a scratch row of the filling color
+        enum { SCRATCH = 64 };
+        unsigned char scratch[4 * SCRATCH];
+        int scratch_a = -1;
+        unsigned char opaque[4] = { filling.get_r(), filling.get_g(), filling.get_b(), 255 };
+        boost::uint32_t opaque_word;
+        memcpy(&opaque_word, opaque, 4);
+
+        int top = h, bottom = 0, left = w, right = 0;
+        for (int i = 0; i < spans.size(); i++)
+        {
+          const span &s = spans[i];
+          if (s.y < 0 || s.y >= h) { continue; }
+          int x_begin = std::max(0, s.x);
+          int x_end = std::min(w, s.x + s.w);
+          if (x_begin >= x_end) { continue; }
+          unsigned char a = (unsigned short)filling.get_a() * s.coverage / 255;
+          if (a == 0) { continue; }
+
+          unsigned char *dst = &buf[4 * (s.y * w + x_begin)];
+          int n = x_end - x_begin;
+          if (a == 255)
+          {
+            boost::uint32_t *row = (boost::uint32_t *)dst;
+            std::fill(row, row + n, opaque_word);
+          }
+          else
+          {
+            if (a != scratch_a)
+            {
+              for (int j = 0; j < SCRATCH; j++)
+              {
+                memcpy(&scratch[4 * j], opaque, 3);
+                scratch[4 * j + 3] = a;
+              }
+              scratch_a = a;
+            }
+            for (; n > 0; n -= SCRATCH, dst += 4 * SCRATCH)
+            {
+              blend_span(dst, scratch, std::min<int>(n, SCRATCH));
+            }
+          }
+          top    = std::min(top, s.y);
+          bottom = std::max(bottom, s.y + 1);
+          left   = std::min(left, x_begin);
+          right  = std::max(right, x_end);
+        }
+        if (top >= bottom) { return true; }
+        return on_change(top, bottom, left, right);
       }
 
       unsigned char *get_buffer()
@@ -275,12 +608,24 @@ namespace lev
         return h;
       }
 
-      virtual color::ptr get_pixel(int x, int y) const
+      virtual unsigned long get_row_stamp(int y) const
+      {
+        if (y < 0 || y >= h) { return 0; }
+        return row_stamps[y];
+      }
+
+      virtual unsigned long get_stamp() const
+      {
+        return stamp;
+      }
+
+      virtual bool get_pixel_value(int x, int y, color &c) const
       {
-        if (x < 0 || x >= get_w() || y < 0 || y >= get_h()) { color::ptr(); }
+        if (x < 0 || x >= get_w() || y < 0 || y >= get_h()) { return false; }
         const unsigned char *buf = get_buffer();
         const unsigned char *pixel = &buf[4 * (y * get_w() + x)];
-        return color::create(pixel[0], pixel[1], pixel[2], pixel[3]);
+        c = color(pixel[0], pixel[1], pixel[2], pixel[3]);
+        return true;
       }
 
       virtual rect::ptr get_rect() const
@@ -308,6 +653,12 @@ namespace lev
         return false;
       }
 
+      virtual bool is_texture_dirty() const
+      {
+        if (! tex) { return false; }
+        return dirty_left < dirty_right && dirty_top < dirty_bottom;
+      }
+
       virtual bool is_texturized() const
       {
         if (tex) { return true; }
@@ -334,8 +685,9 @@ namespace lev
 
       static bitmap::ptr load(const std::string &filename)
       {
-        file::ptr f = file::open(filename);
-        if (! f) { bitmap::ptr(); }
+        file::ptr f = file::open_mapped(filename);
+        if (! f) { f = file::open(filename, "rb"); }
+        if (! f) { return bitmap::ptr(); }
         return bitmap::load_file(f);
       }
 
@@ -346,27 +698,24 @@ namespace lev
         try {
           int w, h;
           std::string data;
-          if (! f->read_all(data)) { throw -1; }
-          boost::shared_ptr<unsigned char> buf;
-          buf.reset(stbi_load_from_memory((unsigned char *)data.c_str(),
-                                          data.length(), &w, &h, NULL, 4),
-                    stbi_image_free);
+          // decoding mapped or memory files in place
+          const unsigned char *view = f->get_data();
+          long len = f->get_size();
+          if (! view)
+          {
+            if (! f->read_all(data)) { throw -1; }
+            view = (const unsigned char *)data.c_str();
+            len = data.length();
+          }
+          unsigned char *buf = stbi_load_from_memory((unsigned char *)view, len,
+                                                     &w, &h, NULL, 4);
           if (! buf) { throw -2; }
-          bmp = bitmap::create(w, h);
-          if (! bmp) { throw -3; }
-
-          for (int y = 0; y < h; y++)
+          // the decoded pixels become the bitmap as they are
+          bmp = impl_bitmap::adopt(w, h, buf, stbi_image_free);
+          if (! bmp)
           {
-            for (int x = 0; x < w; x++)
-            {
-              unsigned char *pixel = buf.get() + (y * w + x) * 4;
-              unsigned char r, g, b, a;
-              r = pixel[0];
-              g = pixel[1];
-              b = pixel[2];
-              a = pixel[3];
-              bmp->set_pixel(x, y, color(r, g, b, a));
-            }
+            stbi_image_free(buf);
+            throw -3;
           }
         }
         catch (...) {
@@ -376,11 +725,33 @@ namespace lev
         return bmp;
       }
 
-      bool on_change()
+      // marks the region [left, right) x [top, bottom) as modified
+      bool on_change(int top = 0, int bottom = -1, int left = 0, int right = -1)
       {
-        if (tex)
+        if (bottom < 0 || bottom > h) { bottom = h; }
+        if (top < 0) { top = 0; }
+        if (right < 0 || right > w) { right = w; }
+        if (left < 0) { left = 0; }
+        stamp++;
+        for (int y = top; y < bottom; y++) { row_stamps[y] = stamp; }
+
+        // keeping the texture, the union of the modified regions is uploaded on drawing
+        if (tex && top < bottom && left < right)
         {
-          tex.reset();
+          if (is_texture_dirty())
+          {
+            dirty_left   = std::min(dirty_left, left);
+            dirty_top    = std::min(dirty_top, top);
+            dirty_right  = std::max(dirty_right, right);
+            dirty_bottom = std::max(dirty_bottom, bottom);
+          }
+          else
+          {
+            dirty_left   = left;
+            dirty_top    = top;
+            dirty_right  = right;
+            dirty_bottom = bottom;
+          }
         }
         return true;
       }
@@ -391,13 +762,13 @@ namespace lev
         try {
           bmp = bitmap::create(width, height);
           if (! bmp) { throw -1; }
+          color c;
           for (int y = 0; y < height; y++)
           {
             for (int x = 0; x < width; x++)
             {
-              color::ptr c;
-              c = get_pixel(long(x) * get_w() / width, long(y) * get_h() / height);
-              if (c) { bmp->set_pixel(x, y, *c); }
+              if (get_pixel_value(long(x) * get_w() / width, long(y) * get_h() / height, c))
+              { bmp->set_pixel(x, y, c); }
             }
           }
         }
@@ -431,7 +802,7 @@ namespace lev
         pixel[1] = c.get_g();
         pixel[2] = c.get_b();
         pixel[3] = c.get_a();
-        return on_change();
+        return on_change(y, y + 1, x, x + 1);
       }
 
       virtual bitmap::ptr sub(int x, int y, int w, int h)
@@ -484,6 +855,7 @@ namespace lev
       {
         if (tex && !force) { return false; }
         tex = texture::create(to_bitmap());
+        dirty_left = dirty_top = dirty_right = dirty_bottom = 0;
         if (! tex) { return false; }
         return true;
       }
@@ -493,6 +865,15 @@ namespace lev
         return bitmap::ptr(wptr);
       }
 
+      virtual bool update_texture()
+      {
+        if (! is_texture_dirty()) { return false; }
+        bool result = tex->update(to_bitmap(), dirty_left, dirty_top,
+                                  dirty_right - dirty_left, dirty_bottom - dirty_top);
+        dirty_left = dirty_top = dirty_right = dirty_bottom = 0;
+        return result;
+      }
+
       virtual canvas::ptr to_canvas()
       {
         return canvas::ptr(wptr);
@@ -506,9 +887,19 @@ namespace lev
       boost::weak_ptr<impl_bitmap> wptr;
       int w, h, descent;
       unsigned char *buf;
+      void (*deleter)(void *);
       boost::shared_ptr<texture> tex;
+      unsigned long stamp;
+      std::vector<unsigned long> row_stamps;
+      int dirty_left, dirty_top, dirty_right, dirty_bottom;
   };
 
+  bitmap::ptr bitmap::adopt(int width, int height, unsigned char *buffer,
+                            void (*deleter)(void *))
+  {
+    return impl_bitmap::adopt(width, height, buffer, deleter);
+  }
+
   bitmap::ptr bitmap::create(int w, int h)
   {
     return impl_bitmap::create(w, h);
@@ -531,6 +922,187 @@ namespace lev
   }
 
 
+  // pixel buffer object entry points, loaded at the first use on a GL context
+#ifndef GL_PIXEL_UNPACK_BUFFER_ARB
+  #define GL_PIXEL_UNPACK_BUFFER_ARB 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW_ARB
+  #define GL_STREAM_DRAW_ARB 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY_ARB
+  #define GL_WRITE_ONLY_ARB 0x88B9
+#endif
+
+  class pbo_functions
+  {
+    public:
+      typedef void (APIENTRY *bind_func)(GLenum target, GLuint buffer);
+      typedef void (APIENTRY *data_func)(GLenum target, ptrdiff_t size,
+                                         const GLvoid *data, GLenum usage);
+      typedef void (APIENTRY *delete_func)(GLsizei n, const GLuint *buffers);
+      typedef void (APIENTRY *gen_func)(GLsizei n, GLuint *buffers);
+      typedef GLvoid* (APIENTRY *map_func)(GLenum target, GLenum access);
+      typedef GLboolean (APIENTRY *unmap_func)(GLenum target);
+
+    protected:
+      pbo_functions() :
+        available(false),
+        bind(NULL), data(NULL), del(NULL), gen(NULL), map(NULL), unmap(NULL)
+      {
+        if (! SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object")) { return; }
+        bind  = (bind_func)SDL_GL_GetProcAddress("glBindBufferARB");
+        data  = (data_func)SDL_GL_GetProcAddress("glBufferDataARB");
+        del   = (delete_func)SDL_GL_GetProcAddress("glDeleteBuffersARB");
+        gen   = (gen_func)SDL_GL_GetProcAddress("glGenBuffersARB");
+        map   = (map_func)SDL_GL_GetProcAddress("glMapBufferARB");
+        unmap = (unmap_func)SDL_GL_GetProcAddress("glUnmapBufferARB");
+        available = bind && data && del && gen && map && unmap;
+      }
+
+    public:
+      static pbo_functions &get()
+      {
+        static pbo_functions funcs;
+        return funcs;
+      }
+
+      bool available;
+      bind_func bind;
+      data_func data;
+      delete_func del;
+      gen_func gen;
+      map_func map;
+      unmap_func unmap;
+  };
+
+  class impl_texture;
+
+  // accounting of the texture memory, shared by all textures
+  class impl_texture_manager : public texture_manager
+  {
+    public:
+      typedef boost::shared_ptr<impl_texture_manager> ptr;
+      typedef std::list<impl_texture *> list_type;
+    protected:
+      impl_texture_manager() :
+        texture_manager(),
+        budget(0), bytes(0), evictions(0), frame(1),
+        peak_bytes(0), resident(0), restores(0), textures()
+      { }
+    public:
+      virtual ~impl_texture_manager() { }
+
+      // allocating bytes for a texture, evicting the others if over the budget
+      bool allocate(long size)
+      {
+        if (budget > 0 && bytes + size > budget) { evict(budget - size); }
+        bytes += size;
+        resident++;
+        if (bytes > peak_bytes) { peak_bytes = bytes; }
+        return true;
+      }
+
+      virtual bool collect()
+      {
+        if (budget <= 0) { return true; }
+        return evict(budget);
+      }
+
+      // evicting the least recently drawn textures until the usage gets under the limit
+      bool evict(long limit);
+
+      virtual bool evict_all()
+      {
+        return evict(0);
+      }
+
+      bool deallocate(long size)
+      {
+        bytes -= size;
+        resident--;
+        return true;
+      }
+
+      static impl_texture_manager::ptr get()
+      {
+        // kept by each texture too, not to be released before them on exit
+        static impl_texture_manager::ptr mgr;
+        if (mgr) { return mgr; }
+        try {
+          mgr.reset(new impl_texture_manager);
+          if (! mgr) { throw -1; }
+        }
+        catch (...) {
+          mgr.reset();
+          lev::debug_print("error on texture manager instance creation");
+        }
+        return mgr;
+      }
+
+      virtual long get_budget() const
+      {
+        return budget;
+      }
+
+      virtual long get_bytes() const
+      {
+        return bytes;
+      }
+
+      virtual int get_count() const
+      {
+        return textures.size();
+      }
+
+      virtual int get_evictions() const
+      {
+        return evictions;
+      }
+
+      virtual long get_peak_bytes() const
+      {
+        return peak_bytes;
+      }
+
+      virtual int get_resident() const
+      {
+        return resident;
+      }
+
+      virtual int get_restores() const
+      {
+        return restores;
+      }
+
+      virtual bool next_frame()
+      {
+        frame++;
+        return true;
+      }
+
+      virtual bool set_budget(long new_budget)
+      {
+        if (new_budget < 0) { return false; }
+        budget = new_budget;
+        return collect();
+      }
+
+      long budget;
+      long bytes;
+      int evictions;
+      unsigned long frame;
+      long peak_bytes;
+      int resident;
+      int restores;
+      // ordered from the least recently drawn
+      list_type textures;
+  };
+
+  texture_manager::ptr texture_manager::get()
+  {
+    return impl_texture_manager::get();
+  }
+
   // texture class implementation
   class impl_texture : public texture
   {
@@ -540,7 +1112,9 @@ namespace lev
       impl_texture(int w, int h) :
         texture(),
         descent(0),
-        img_w(w), img_h(h), tex_w(1), tex_h(1)
+        img_w(w), img_h(h), tex_w(1), tex_h(1),
+        index(0), pbo(0),
+        last_frame(0), mgr(), pos(), path(), source()
       {
         while(tex_w < w) { tex_w <<= 1; }
         while(tex_h < h) { tex_h <<= 1; }
@@ -550,11 +1124,16 @@ namespace lev
     public:
       virtual ~impl_texture()
       {
-        if (index > 0)
+        release();
+        if (mgr)
         {
-//printf("Rel: %d\n", index);
-          glDeleteTextures(1, &index);
-          index = 0;
+          mgr->textures.erase(pos);
+          mgr.reset();
+        }
+        if (pbo > 0)
+        {
+          pbo_functions::get().del(1, &pbo);
+          pbo = 0;
         }
       }
 
@@ -564,7 +1143,7 @@ namespace lev
                            int w = -1, int h = -1,
                            unsigned char alpha = 255) const
       {
-        if (! dst) { return NULL; }
+        if (! dst) { return false; }
 //printf("TEXTURE BLIT ON!\n");
 
         if (w < 0) { w = img_w; }
@@ -574,22 +1153,9 @@ namespace lev
         double tex_w = coord_x * w / img_w;
         double tex_h = coord_y * h / img_h;
 
-        dst->set_current();
-        glBindTexture(GL_TEXTURE_2D, index);
-        glEnable(GL_TEXTURE_2D);
-        glBegin(GL_QUADS);
-          glColor4ub(255, 255, 255, alpha);
-          glTexCoord2d(tex_x, tex_y);
-          glVertex2i(dst_x, dst_y);
-          glTexCoord2d(tex_x, tex_y + tex_h);
-          glVertex2i(dst_x, dst_y + h);
-          glTexCoord2d(tex_x + tex_w, tex_y + tex_h);
-          glVertex2i(dst_x + w, dst_y + h);
-          glTexCoord2d(tex_x + tex_w, tex_y);
-          glVertex2i(dst_x + w, dst_y);
-        glEnd();
-        glDisable(GL_TEXTURE_2D);
-        return true;
+        // queued, drawn on the next flush of the screen's sprite batch
+        return dst->draw_quad(wptr.lock(), dst_x, dst_y, w, h,
+                              tex_x, tex_y, tex_w, tex_h, alpha);
       }
 
       static impl_texture::ptr create(bitmap::ptr src)
@@ -600,20 +1166,14 @@ namespace lev
           tex.reset( new impl_texture(src->get_w(), src->get_h()) );
           if (! tex) { throw -1; }
           tex->wptr = tex;
-          glGenTextures(1, &tex->index);
-//printf("Gen: %d\n", tex->index);
-          if (tex->index == 0) { throw -2; }
           tex->descent = src->get_descent();
-
-          glBindTexture(GL_TEXTURE_2D, tex->index);
-          glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-          glTexImage2D(GL_TEXTURE_2D, 0 /* level */, GL_RGBA, tex->tex_w, tex->tex_h, 0 /* border */,
-                       GL_RGBA, GL_UNSIGNED_BYTE, NULL /* only buffer reservation */);
-          glTexSubImage2D(GL_TEXTURE_2D, 0, 0 /* x offset */, 0 /* y offset */,
-                          tex->img_w, tex->img_h, GL_RGBA, GL_UNSIGNED_BYTE,
-                          src->get_buffer());
+          if (! tex->upload(src)) { throw -2; }
+          // the texture can be regenerated while the bitmap is alive
+          tex->source = src;
+          tex->mgr = impl_texture_manager::get();
+          if (! tex->mgr) { throw -3; }
+          tex->pos = tex->mgr->textures.insert(tex->mgr->textures.end(), tex.get());
+          tex->last_frame = tex->mgr->frame;
         }
         catch (...) {
           tex.reset();
@@ -622,6 +1182,20 @@ namespace lev
         return tex;
       }
 
+      // freeing the GL texture, the texture is restored on the next drawing
+      bool evict()
+      {
+        if (index == 0) { return false; }
+        if (! is_regenerable()) { return false; }
+        release();
+        return true;
+      }
+
+      long get_bytes() const
+      {
+        return 4 * long(tex_w) * tex_h;
+      }
+
       virtual int get_descent() const
       {
         return descent;
@@ -632,11 +1206,27 @@ namespace lev
         return img_h;
       }
 
+      virtual unsigned int get_index() const
+      {
+        return index;
+      }
+
       virtual int get_w() const
       {
         return img_w;
       }
 
+      bool is_regenerable() const
+      {
+        if (! source.expired()) { return true; }
+        return ! path.empty();
+      }
+
+      virtual bool is_resident() const
+      {
+        return index > 0;
+      }
+
       virtual bool is_texturized() const
       {
         return true;
@@ -649,6 +1239,8 @@ namespace lev
           bitmap::ptr img = bitmap::load(file);
           if (! img) { throw -1; }
           tex = impl_texture::create(img);
+          // the temporary bitmap is gone, reloaded from the file if evicted
+          if (tex) { tex->path = file; }
         }
         catch (...) {
           tex.reset();
@@ -657,6 +1249,27 @@ namespace lev
         return tex;
       }
 
+      bool release()
+      {
+        if (index == 0) { return false; }
+//printf("Rel: %d\n", index);
+        glDeleteTextures(1, &index);
+        index = 0;
+        if (mgr) { mgr->deallocate(get_bytes()); }
+        return true;
+      }
+
+      bool restore()
+      {
+        bitmap::ptr src = source.lock();
+        if (! src && ! path.empty()) { src = bitmap::load(path); }
+        if (! src) { return false; }
+        if (src->get_w() != img_w || src->get_h() != img_h) { return false; }
+        if (! upload(src)) { return false; }
+        mgr->restores++;
+        return true;
+      }
+
       virtual bool set_descent(int d)
       {
         descent = d;
@@ -668,14 +1281,137 @@ namespace lev
         return drawable::ptr(wptr);
       }
 
+      virtual bool touch()
+      {
+        if (! mgr) { return index > 0; }
+        if (index == 0 && ! restore()) { return false; }
+        // moving to the most recently drawn end
+        mgr->textures.splice(mgr->textures.end(), mgr->textures, pos);
+        last_frame = mgr->frame;
+        return true;
+      }
+
+      virtual bool update(bitmap::ptr src, int x, int y, int w, int h)
+      {
+        if (! src || index == 0) { return false; }
+        if (src->get_w() != img_w || src->get_h() != img_h) { return false; }
+        if (x < 0) { w += x; x = 0; }
+        if (y < 0) { h += y; y = 0; }
+        if (x + w > img_w) { w = img_w - x; }
+        if (y + h > img_h) { h = img_h - y; }
+        if (w <= 0 || h <= 0) { return false; }
+
+        LEV_PROFILE_ZONE("texture_upload");
+        const unsigned char *buf = src->get_buffer();
+        glBindTexture(GL_TEXTURE_2D, index);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        pbo_functions &funcs = pbo_functions::get();
+        if (funcs.available)
+        {
+          if (pbo == 0) { funcs.gen(1, &pbo); }
+          if (pbo > 0)
+          {
+            funcs.bind(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+            // orphaning the previous storage, not to wait for the pending transfer
+            funcs.data(GL_PIXEL_UNPACK_BUFFER_ARB, 4 * w * h, NULL, GL_STREAM_DRAW_ARB);
+            unsigned char *mapped =
+              (unsigned char *)funcs.map(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+            if (mapped)
+            {
+              for (int row = 0; row < h; row++)
+              {
+                memcpy(mapped + 4 * w * row, buf + 4 * ((y + row) * img_w + x), 4 * w);
+              }
+              funcs.unmap(GL_PIXEL_UNPACK_BUFFER_ARB);
+              glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+                              NULL /* offset in the pixel buffer */);
+              funcs.bind(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+              return true;
+            }
+            funcs.bind(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+          }
+        }
+
+        // direct upload, reading the sub rectangle out of the whole rows
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, img_w);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+                        buf + 4 * (y * img_w + x));
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return true;
+      }
+
+      // allocating the GL texture and uploading the whole bitmap
+      bool upload(bitmap::ptr src)
+      {
+        LEV_PROFILE_ZONE("texture_upload");
+        impl_texture_manager::ptr m = mgr ? mgr : impl_texture_manager::get();
+        if (m) { m->allocate(get_bytes()); }
+        glGenTextures(1, &index);
+//printf("Gen: %d\n", index);
+        if (index == 0)
+        {
+          if (m) { m->deallocate(get_bytes()); }
+          return false;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, index);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        for (int i = 0; i < 8 && glGetError() != GL_NO_ERROR; i++) { }
+        glTexImage2D(GL_TEXTURE_2D, 0 /* level */, GL_RGBA, tex_w, tex_h, 0 /* border */,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL /* only buffer reservation */);
+        if (glGetError() == GL_OUT_OF_MEMORY && m)
+        {
+          // the driver is out of memory, retrying after freeing the evictable textures
+          m->evict_all();
+          glBindTexture(GL_TEXTURE_2D, index);
+          glTexImage2D(GL_TEXTURE_2D, 0 /* level */, GL_RGBA, tex_w, tex_h, 0 /* border */,
+                       GL_RGBA, GL_UNSIGNED_BYTE, NULL /* only buffer reservation */);
+          if (glGetError() == GL_OUT_OF_MEMORY)
+          {
+            glDeleteTextures(1, &index);
+            index = 0;
+            m->deallocate(get_bytes());
+            return false;
+          }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0 /* x offset */, 0 /* y offset */,
+                        img_w, img_h, GL_RGBA, GL_UNSIGNED_BYTE, src->get_buffer());
+        return true;
+      }
+
       boost::weak_ptr<impl_texture> wptr;
       int img_w, img_h;
       int tex_w, tex_h;
       int descent;
       double coord_x, coord_y;
       GLuint index;
+      // pixel buffer for the partial updates
+      GLuint pbo;
+
+      // memory management
+      unsigned long last_frame;
+      impl_texture_manager::ptr mgr;
+      impl_texture_manager::list_type::iterator pos;
+      std::string path;
+      boost::weak_ptr<bitmap> source;
   };
 
+  bool impl_texture_manager::evict(long limit)
+  {
+    list_type::iterator i = textures.begin();
+    while (bytes > limit && i != textures.end())
+    {
+      impl_texture *tex = *i++;
+      // the rest are drawn in the current frame, possibly queued in a sprite batch
+      if (tex->last_frame == frame) { break; }
+      if (tex->evict()) { evictions++; }
+    }
+    return bytes <= limit;
+  }
+
   texture::ptr texture::create(bitmap::ptr src)
   {
     return impl_texture::create(src);
@@ -1197,7 +1933,7 @@ namespace lev
       struct item_type
       {
         item_type() :
-          x(-1), y(-1), fixed(false),
+          x(-1), line(-1),
           func_hover(), func_lsingle(),
           auto_fill(true)
         { }
@@ -1208,8 +1944,23 @@ namespace lev
         luabind::object func_hover;
         luabind::object func_lsingle;
         bool auto_fill;
-        int x, y;
-        bool fixed;
+        int x, line;
+      };
+
+      // line table entry, lines[i + 1] begins with the item breaking lines[i]
+      struct line_type
+      {
+        line_type(int first = 0, int y = 0) :
+          first(first), y(y), width(0), ascent(0), descent(0), closed(false)
+        { }
+
+        int get_h() const { return ascent + descent; }
+
+        int first;
+        int y;
+        int width;
+        int ascent, descent;
+        bool closed;
       };
 
     protected:
@@ -1217,8 +1968,10 @@ namespace lev
         layout(),
         width_stop(width_stop),
         font_text(), font_ruby(),
-        items(), texturized(false)
+        items(), lines(), laid(0), max_width(0), next_index(0),
+        texturized(false)
       {
+        lines.push_back(line_type());
         font_text = font::load0();
         font_ruby = font::load0();
         if (font_ruby) { font_ruby->set_size(font_ruby->get_size() / 2); }
@@ -1230,141 +1983,23 @@ namespace lev
     public:
       virtual ~impl_layout() { }
 
-      int calc_max_width() const
+      int calc_y(const item_type &item) const
       {
-        int max_w = 0;
-        int x = 0;
-        for (int i = 0; i < items.size(); i++)
-        {
-          const item_type &item = items[i];
-          if (! item.img ||
-              (item.auto_fill && width_stop > 0 && x > 0 && x + item.img->get_w() > width_stop))
-          {
-            // newline
-            if (x > max_w) { max_w = x; }
-            x = 0;
-          }
-          if (item.img)
-          {
-            x += item.img->get_w();
-          }
-        }
-        return (max_w > x ? max_w : x);
-      }
-
-      bool calc_position(int index)
-      {
-        int x = 0;
-        int y = 0;
-//        int max_h = 0;
-        int max_ascent = 0;
-        int max_descent = 0;
-
-        if (index < 0 || index >= items.size()) { return false; }
-        if (! items[index].img) { return false; }
-
-        // if position is already fixed, return it
-        if (items[index].fixed) { return true; }
-
-        // back scan
-        int i = index - 1;
-        for (; i >= 0; i--)
-        {
-          item_type &item = items[i];
-          if (item.fixed)
-          {
-            x = item.x;
-            y = item.y;
-//            max_h = item.img->get_h();
-            max_ascent = item.img->get_ascent();
-            max_descent = item.img->get_descent();
-            break;
-          }
-        }
-        if (i < 0) { i = 0; }
-
-        // fore scan
-        for (; i < items.size(); i++)
-        {
-          item_type &item = items[i];
-          if (! item.img ||
-              (item.auto_fill && width_stop > 0 && x > 0 && x + item.img->get_w() > width_stop))
-          {
-            // newline
-            x = 0;
-//            y += max_h;
-//printf("MAX ASCENT: %d, MAX DESCENT: %d\n", max_ascent, max_descent);
-            y += (max_ascent + max_descent);
-//            max_h = 0;
-            max_ascent = 0;
-            max_descent = 0;
-            // back scan for position fixing
-            for (int j = i - 1; j >= 0; j--)
-            {
-              if (items[j].fixed) { break; }
-              if (items[j].img)
-              {
-                items[j].y = y - items[j].img->get_h();
-//                items[j].y = y - items[j].img->get_ascent();
-                items[j].fixed = true;
-              }
-            }
-            if (i > index)
-            {
-              return true;
-            }
-          }
-//if (! item.auto_fill && width_stop > 0 && x > 0 && x + item.img->get_w() > width_stop)
-//{
-//  printf("NO AUTO FILL!\n");
-//}
-          if (item.img)
-          {
-            // calc by next item
-            item.x = x;
-            x += item.img->get_w();
-//            if (item.img->get_h() > max_h) { max_h = item.img->get_h(); }
-            if (item.img->get_ascent() > max_ascent) { max_ascent = item.img->get_ascent(); }
-            if (item.img->get_descent() > max_descent) { max_descent = item.img->get_descent(); }
-          }
-        }
-//        y += max_h;
-        y += (max_ascent + max_descent);
-//        items[index].y = y - items[index].img->get_h();
-        items[index].y = y - max_descent - items[index].img->get_ascent();
-//        items[index].y = y - items[index].img->get_ascent();
-        return true;
-      }
-
-      int calc_total_height() const
-      {
-        int x = 0;
-        int y = 0;
-        int max_h = 0;
-        for (int i = 0; i < items.size(); i++)
-        {
-          const item_type &item = items[i];
-          if (! item.img || (width_stop > 0 && x > 0 && x + item.img->get_w() > width_stop))
-          {
-            // newline
-            x = 0;
-            y += max_h;
-            max_h = 0;
-          }
-          if (item.img)
-          {
-            // calc by next item
-            x += item.img->get_w();
-            if (item.img->get_h() > max_h) { max_h = item.img->get_h(); }
-          }
-        }
-        y += max_h;
-        return y;
+        const line_type &l = lines[item.line];
+        // items on a closed line are aligned to its bottom, and items on the
+        // last line to its baseline
+        if (l.closed) { return l.y + l.get_h() - item.img->get_h(); }
+        return l.y + l.ascent - item.img->get_ascent();
       }
 
       virtual bool clear()
       {
         items.clear();
+        lines.clear();
+        lines.push_back(line_type());
+        laid = 0;
+        max_width = 0;
+        next_index = 0;
         texturized = false;
         return true;
       }
@@ -1401,8 +2036,7 @@ namespace lev
           item_type &item = items[i];
           if (item.img_showing)
           {
-            calc_position(i);
-            item.img_showing->draw_on(dst, x + item.x, y + item.y, alpha);
+            item.img_showing->draw_on(dst, x + item.x, y + calc_y(item), alpha);
           }
         }
 //printf("\n");
@@ -1421,12 +2055,13 @@ namespace lev
 
       virtual int get_h() const
       {
-        return calc_total_height();
+        const line_type &last = lines.back();
+        return last.y + last.get_h();
       }
 
       int get_next_index() const
       {
-        for (int i = 0; i < items.size(); i++)
+        for (int i = next_index; i < items.size(); i++)
         {
           if (! items[i].img) { continue; }
           if (! items[i].img_showing) { return i; }
@@ -1447,7 +2082,7 @@ namespace lev
       virtual int get_w() const
       {
         if (width_stop > 0) { return width_stop; }
-        return calc_max_width();
+        return max_width;
       }
 
       virtual bool is_done() const
@@ -1466,8 +2101,7 @@ namespace lev
           if (! item.img_hover) { continue; }
           if (! item.img_showing) { continue; }
 
-          calc_position(i);
-          rect r(item.x, item.y, item.img->get_w(), item.img->get_h());
+          rect r(item.x, calc_y(item), item.img->get_w(), item.img->get_h());
           if (r.include(x, y))
           {
 //            if (item.func_lsingle && type(item.func_lsingle) == LUA_TFUNCTION)
@@ -1491,8 +2125,7 @@ namespace lev
           if (! item.img_hover) { continue; }
           if (! item.img_showing) { continue; }
 
-          calc_position(i);
-          rect r(item.x, item.y, item.img->get_w(), item.img->get_h());
+          rect r(item.x, calc_y(item), item.img->get_w(), item.img->get_h());
           if (r.include(x, y) && item.img_showing == item.img_hover)
           {
             if (item.func_lsingle && type(item.func_lsingle) == LUA_TFUNCTION)
@@ -1516,8 +2149,7 @@ namespace lev
           if (! item.img_hover) { continue; }
           if (! item.img_showing) { continue; }
 
-          calc_position(i);
-          rect r(item.x, item.y, item.img->get_w(), item.img->get_h());
+          rect r(item.x, calc_y(item), item.img->get_w(), item.img->get_h());
           if (r.include(x, y))
           {
             // (x, y) is in the rect
@@ -1542,16 +2174,66 @@ namespace lev
         return true;
       }
 
-      virtual bool rearrange()
+      // places the item next to the previously laid one, O(1)
+      bool place(int index)
       {
-        for (int i = 0; i < items.size(); i++)
+        item_type &item = items[index];
+        line_type *l = &lines.back();
+        if (! item.img ||
+            (item.auto_fill && width_stop > 0 && l->width > 0 &&
+             l->width + item.img->get_w() > width_stop))
         {
-          items[i].fixed = false;
+          // newline
+          l->closed = true;
+          lines.push_back(line_type(index, l->y + l->get_h()));
+          l = &lines.back();
         }
-        for (int i = 0; i < items.size(); i++)
+        item.line = lines.size() - 1;
+        if (item.img)
+        {
+          item.x = l->width;
+          l->width += item.img->get_w();
+          if (item.img->get_ascent() > l->ascent) { l->ascent = item.img->get_ascent(); }
+          if (item.img->get_descent() > l->descent) { l->descent = item.img->get_descent(); }
+          if (l->width > max_width) { max_width = l->width; }
+        }
+        laid = index + 1;
+        return true;
+      }
+
+      virtual bool rearrange()
+      {
+        return reflow(0);
+      }
+
+      // lays out the items again from the first changed one
+      bool reflow(int from)
+      {
+        if (from < 0) { from = 0; }
+        if (from < laid)
         {
-          calc_position(i);
+          // restarting from the beginning of the line including the item
+          int l = items[from].line;
+          from = lines[l].first;
+          if (l == 0)
+          {
+            lines.clear();
+            lines.push_back(line_type());
+          }
+          else
+          {
+            // lines[l - 1] is kept as is, its breaking item is placed again
+            lines.resize(l);
+            lines.back().closed = false;
+          }
+          max_width = 0;
+          for (int i = 0; i < lines.size(); i++)
+          {
+            if (lines[i].width > max_width) { max_width = lines[i].width; }
+          }
+          laid = from;
         }
+        for (int i = laid; i < items.size(); i++) { place(i); }
         return true;
       }
 
@@ -1571,6 +2253,7 @@ namespace lev
           i.img_hover = hover;
           i.func_hover = hover_func;
           i.func_lsingle = lsingle_func;
+          reflow(items.size() - 1);
           texturized = false;
           return true;
         }
@@ -1591,8 +2274,11 @@ namespace lev
           bitmap::ptr hover_img;
 
           img = font_text->rasterize(text, color_fg, color::ptr(), color_shade);
-          img->stroke_line(0, img->get_h() - 1,
-                           img->get_w() - 1, img->get_h() - 1, color_fg, 1, "dot");
+          if (color_fg)
+          {
+            img->stroke_line(0, img->get_h() - 1,
+                             img->get_w() - 1, img->get_h() - 1, *color_fg, 1, "dot");
+          }
           hover_img = font_text->rasterize(text, hover_fg, hover_bg, color::ptr());
           return reserve_clickable(img, hover_img, lsingle_func, hover_func);
         }
@@ -1609,6 +2295,7 @@ namespace lev
           items.push_back(item_type());
           (items.end() - 1)->img = img;
           (items.end() - 1)->auto_fill = auto_filling;
+          reflow(items.size() - 1);
           texturized = false;
           return true;
         }
@@ -1624,6 +2311,7 @@ namespace lev
         (items.end() - 1)->img = spacer::create(0, font_text->get_size(), 0);
         // adding new line
         items.push_back(item_type());
+        reflow(items.size() - 2);
         texturized = false;
         return true;
       }
@@ -1696,6 +2384,12 @@ namespace lev
         if (index >= items.size()) { return false; }
         item_type &item = items[index];
         item.img_showing = item.img;
+        // skipping the shown items on the next search
+        while (next_index < items.size() &&
+               (! items[next_index].img || items[next_index].img_showing))
+        {
+          next_index++;
+        }
         return true;
       }
 
@@ -1735,6 +2429,12 @@ namespace lev
       int width_stop;
       // all items
       std::vector<item_type> items;
+      // line table of the laid out items
+      std::vector<line_type> lines;
+      int laid;
+      int max_width;
+      // no items before it are waiting for showing
+      int next_index;
   };
 
   layout::ptr layout::create(int width_stop)
@@ -1777,11 +2477,26 @@ int luaopen_lev_image(lua_State *L)
           def("sub_c", &bitmap::sub)
         ],
       class_<texture, drawable, boost::shared_ptr<drawable> >("texture")
+        .property("is_resident", &texture::is_resident)
         .scope
         [
           def("create", &texture::create),
           def("create", &texture::load)
         ],
+      class_<texture_manager, base, boost::shared_ptr<base> >("texture_manager")
+        .property("budget", &texture_manager::get_budget, &texture_manager::set_budget)
+        .property("bytes", &texture_manager::get_bytes)
+        .def("collect", &texture_manager::collect)
+        .property("count", &texture_manager::get_count)
+        .def("evict_all", &texture_manager::evict_all)
+        .property("evictions", &texture_manager::get_evictions)
+        .property("peak_bytes", &texture_manager::get_peak_bytes)
+        .property("resident", &texture_manager::get_resident)
+        .property("restores", &texture_manager::get_restores)
+        .scope
+        [
+          def("get", &texture_manager::get)
+        ],
       class_<animation, drawable, boost::shared_ptr<drawable> >("animation")
         .property("current", &animation::get_current)
         .scope
@@ -1847,6 +2562,7 @@ int luaopen_lev_image(lua_State *L)
   lev["layout"]        = classes["layout"]["create"];
   lev["texture"]       = classes["texture"]["create"];
   lev["tex2d"]         = classes["texture"]["create"];
+  lev["texture_manager"] = classes["texture_manager"]["get"];
   lev["transition"]    = classes["transition"]["create"];
 
 //  image["levana_icon"] = classes["image"]["levana_icon"];
@@ -87,6 +87,11 @@ namespace lev
 
       // open method
       static archive::ptr open(const std::string &archive_path);
+      // read-only handle pooled by path, reopened when the file changes
+      static archive::ptr open_shared(const std::string &archive_path);
+      // file reading the entry from the archive on demand, NULL for encrypted entries
+      virtual boost::shared_ptr<class file>
+        open_stream(const std::string &entry_name, const char *password = NULL) = 0;
 
       // read methods
       virtual bool read(const std::string &entry_name, std::string &data,
@@ -100,6 +105,45 @@ namespace lev
                               const char *password = NULL);
   };
 
+  // collecting many entries, deflating them in parallel on commit
+  class archive_builder : public base
+  {
+    public:
+      typedef boost::shared_ptr<archive_builder> ptr;
+    protected:
+      archive_builder() : base() { }
+    public:
+      virtual ~archive_builder() { }
+
+      // negative level stores the data without compression
+      virtual bool add_data(const std::string &entry_name, const std::string &data,
+                            int compression_level = 1) = 0;
+      bool add_data2(const std::string &entry_name, const std::string &data)
+      {
+        return add_data(entry_name, data);
+      }
+      bool add_file(const std::string &file) { return add_file_to(file, file); }
+      // the file is read by the workers on commit
+      virtual bool add_file_to(const std::string &file, const std::string &entry_name,
+                               int compression_level = 1) = 0;
+      bool add_file_to2(const std::string &file, const std::string &entry_name)
+      {
+        return add_file_to(file, entry_name);
+      }
+
+      // writing all the entries, then the central directory once
+      virtual bool commit() = 0;
+      static archive_builder::ptr create(const std::string &archive_path, int threads = 2);
+      static archive_builder::ptr create1(const std::string &archive_path)
+      {
+        return create(archive_path);
+      }
+
+      virtual int get_count() const = 0;
+      virtual int get_threads() const = 0;
+      virtual type_id get_type_id() const { return LEV_TARCHIVE_BUILDER; }
+  };
+
 }
 
 #endif // _ARCHIVE_HPP
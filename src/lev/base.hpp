@@ -33,6 +33,7 @@ namespace lev
         LEV_TBASE = 1,
 
           LEV_TARCHIVE,
+          LEV_TARCHIVE_BUILDER,
           LEV_TCOLOR,
           LEV_TDEBUGGER,
 
@@ -59,8 +60,11 @@ namespace lev
 
           LEV_TFILEPATH,
           LEV_TFONT,
+          LEV_TLOAD_REQUEST,
+          LEV_TLOADER,
           LEV_TMIXER,
           LEV_TPOINT,
+          LEV_TPROFILER,
           LEV_TRECT,
           LEV_TSIZE,
           LEV_TSOUND,
@@ -69,6 +73,7 @@ namespace lev
           LEV_TSTOP_WATCH,
           LEV_TSYSTEM,
           LEV_TTEMP_NAME,
+          LEV_TTEXTURE_MANAGER,
 
           LEV_TTIMER,
             LEV_TCLOCK,
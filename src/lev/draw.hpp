@@ -16,6 +16,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include <lua.h>
+#include <vector>
 
 extern "C" {
   int luaopen_lev_draw(lua_State *L);
@@ -95,6 +96,13 @@ namespace lev
       virtual bool on_motion(int x, int y) = 0;
   };
 
+  // horizontal run of pixels, the coverage (0-255) scales the alpha of the filling
+  struct span
+  {
+    int x, y, w;
+    unsigned char coverage;
+  };
+
   class canvas : public drawable
   {
     public:
@@ -122,7 +130,7 @@ namespace lev
       bool clear0() { return clear(); }
       bool clear3(unsigned char r, unsigned char g, unsigned char b)
       { return clear(r, g, b); }
-      bool clear_color(color::ptr c = color::transparent());
+      bool clear_color(const color &c = color(0, 0, 0, 0));
 
       // draw methods
       virtual bool draw(drawable::ptr src, int x = 0, int y = 0, unsigned char alpha = 255) = 0;
@@ -130,21 +138,40 @@ namespace lev
       static int draw_l(lua_State *L);
 
       // fill methods
-      virtual bool fill_circle(int cx, int cy, int radius, color::ptr filling);
-      virtual bool fill_rect(int x, int y, int w, int h, color::ptr filling);
+      virtual bool fill_circle(int cx, int cy, int radius, const color &filling);
+      virtual bool fill_rect(int x, int y, int w, int h, const color &filling);
+      // every primitive is rasterized into spans and drawn by this method
+      virtual bool fill_spans(const std::vector<span> &spans, const color &filling);
 
       // get methods
-      virtual color::ptr get_pixel(int x, int y) const { return color::ptr(); }
+      color::ptr get_pixel(int x, int y) const;
+      // copying the pixel into c without allocation, false if out of range
+      virtual bool get_pixel_value(int x, int y, color &c) const { return false; }
       virtual type_id get_type_id() const { return LEV_TCANVAS; }
 
       // stroke methods
       virtual bool stroke_circle(int x, int y, int radius, color *border, int width) { return false; }
-      virtual bool stroke_line(int x1, int y1, int x2, int y2, color::ptr c, int width,
+      virtual bool stroke_line(int x1, int y1, int x2, int y2, const color &c, int width,
                        const std::string &style = "");
-      virtual bool stroke_line6(int x1, int y1, int x2, int y2, color::ptr c, int width)
+      virtual bool stroke_line6(int x1, int y1, int x2, int y2, const color &c, int width)
       { return stroke_line(x1, y1, x2, y2, c, width); }
 
-      virtual bool stroke_rect(int x, int y, int w, int h, color::ptr border, int width);
+      virtual bool stroke_rect(int x, int y, int w, int h, const color &border, int width);
+
+      // entries for Lua, returning false on nil colors
+      bool clear_color_ptr(color::ptr c)
+      { return c ? clear_color(*c) : false; }
+      bool fill_circle_ptr(int cx, int cy, int radius, color::ptr filling)
+      { return filling ? fill_circle(cx, cy, radius, *filling) : false; }
+      bool fill_rect_ptr(int x, int y, int w, int h, color::ptr filling)
+      { return filling ? fill_rect(x, y, w, h, *filling) : false; }
+      bool stroke_line_ptr(int x1, int y1, int x2, int y2, color::ptr c, int width,
+                           const std::string &style)
+      { return c ? stroke_line(x1, y1, x2, y2, *c, width, style) : false; }
+      bool stroke_line6_ptr(int x1, int y1, int x2, int y2, color::ptr c, int width)
+      { return c ? stroke_line(x1, y1, x2, y2, *c, width) : false; }
+      bool stroke_rect_ptr(int x, int y, int w, int h, color::ptr border, int width)
+      { return border ? stroke_rect(x, y, w, h, *border, width) : false; }
 
       virtual canvas::ptr to_canvas() = 0;
   };
@@ -14,6 +14,7 @@
 #include "base.hpp"
 #include <boost/shared_ptr.hpp>
 #include <luabind/luabind.hpp>
+#include <vector>
 
 extern "C" {
   int luaopen_lev_fs(lua_State *L);
@@ -31,22 +32,43 @@ namespace lev
     public:
       virtual ~file() { }
 
+      // taking over an opened SDL_RWops, closed with the file
+      static file::ptr adopt_ops(void *ops);
       virtual bool close() = 0;
       virtual bool eof() const = 0;
       virtual bool find(const void *chunk, int length) = 0;
+      // seeking to the end of the first match from the current position,
+      // numtry limits the start positions to try (0 for the whole file)
       virtual bool find_data(const std::string &data, int numtry = 1) = 0;
+      // offsets of the non-overlapping matches up to the end of the file
+      virtual long find_all(const std::string &data, std::vector<long> &offsets) = 0;
+      // whole contents in memory if available (mapped or memory files), NULL otherwise
+      virtual const unsigned char *get_data() { return NULL; }
       virtual void *get_ops() = 0;
       virtual long get_size() const = 0;
       virtual type_id get_type_id() const { return LEV_TFILE; }
+      // iterator function yielding the lines, for "for line in f:lines() do ... end"
       static int lines_l(lua_State *L);
       static file::ptr open(const std::string &path, const std::string &mode = "r");
       static file::ptr open1(const std::string &path) { return open(path); }
+      static file::ptr open_mapped(const std::string &path);
+      // read-only file over [offset, offset + size) of the memory of src, sharing it
+      static file::ptr open_view(file::ptr src, long offset, long size);
+      // next bytes without consuming them
+      virtual bool peek(std::string &content, int count) = 0;
+      // pushing the next line (without the line break) to the Lua stack
+      virtual bool push_line(lua_State *L) = 0;
       virtual size_t read(void *buf, size_t size, size_t maxnum) = 0;
       virtual bool read_all(std::string &content) = 0;
       virtual bool read_count(std::string &content, int count) = 0;
       virtual unsigned short read_le16() = 0;
+      // decoding up to count values, returns the decoded number
+      virtual int read_le16_array(unsigned short *values, int count) = 0;
       virtual unsigned long read_le32() = 0;
+      virtual int read_le32_array(unsigned long *values, int count) = 0;
       virtual bool read_line(std::string &content) = 0;
+      // reading through delim, content gets the bytes before it
+      virtual bool read_until(std::string &content, char delim) = 0;
       static int read_l(lua_State *L);
       virtual bool save(const std::string &path) = 0;
       virtual long seek(long pos) = 0;
@@ -35,6 +35,11 @@ namespace lev
       // clone method
       virtual bitmap::ptr clone() { return bitmap::ptr(); }
 
+      // adopt method (static), taking the ownership of the RGBA buffer
+      // released with the deleter (e.g. free, stbi_image_free), or delete [] if NULL
+      static bitmap::ptr adopt(int width, int height, unsigned char *buffer,
+                               void (*deleter)(void *) = NULL);
+
       // create method (static)
       static bitmap::ptr create(int width, int height);
 
@@ -42,10 +47,15 @@ namespace lev
       virtual unsigned char *get_buffer() { return NULL; }
       virtual const unsigned char *get_buffer() const { return NULL; }
       virtual rect::ptr get_rect() const = 0;
+      // modification stamps of the whole bitmap and each row
+      virtual unsigned long get_row_stamp(int y) const { return 0; }
       virtual size::ptr get_size() const = 0;
+      virtual unsigned long get_stamp() const { return 0; }
       virtual boost::shared_ptr<texture> get_texture() const = 0;
 
       virtual type_id get_type_id() const { return LEV_TBITMAP; }
+      // whether the kept texture is behind the pixels
+      virtual bool is_texture_dirty() const { return false; }
 //      static bitmap* levana_icon();
       static bitmap::ptr load(const std::string &filename);
       static bitmap::ptr load_file(boost::shared_ptr<class file> f);
@@ -55,6 +65,8 @@ namespace lev
       virtual bool set_pixel(int x, int y, const color &c) = 0;
       virtual bitmap::ptr sub(int x, int y, int w, int h) = 0;
       virtual bitmap::ptr to_bitmap() = 0;
+      // re-uploading the modified region into the kept texture
+      virtual bool update_texture() { return false; }
   };
 
   class texture : public drawable
@@ -71,8 +83,44 @@ namespace lev
                            int w = -1, int h = -1,
                            unsigned char alpha = 255) const = 0;
       static texture::ptr create(bitmap::ptr src);
+      virtual unsigned int get_index() const { return 0; }
       virtual type_id get_type_id() const { return LEV_TTEXTURE; }
+      // whether the GL texture is allocated (not evicted by the texture manager)
+      virtual bool is_resident() const { return true; }
       static boost::shared_ptr<texture> load(const std::string &file);
+      // marking as drawn, restoring the evicted texture from its source
+      virtual bool touch() { return true; }
+      // re-uploading the rectangle of the source bitmap
+      virtual bool update(bitmap::ptr src, int x, int y, int w, int h) { return false; }
+  };
+
+  class texture_manager : public base
+  {
+    public:
+      typedef boost::shared_ptr<texture_manager> ptr;
+    protected:
+      texture_manager() : base() { }
+    public:
+      virtual ~texture_manager() { }
+
+      // evicting the least recently drawn textures until the usage fits the budget
+      virtual bool collect() = 0;
+      // evicting all textures not drawn in the current frame
+      virtual bool evict_all() = 0;
+      static texture_manager::ptr get();
+      // allowed bytes of the texture memory, 0 for no limit
+      virtual long get_budget() const = 0;
+      // allocated bytes including the power-of-two padding
+      virtual long get_bytes() const = 0;
+      virtual int get_count() const = 0;
+      virtual int get_evictions() const = 0;
+      virtual long get_peak_bytes() const = 0;
+      virtual int get_resident() const = 0;
+      virtual int get_restores() const = 0;
+      virtual type_id get_type_id() const { return LEV_TTEXTURE_MANAGER; }
+      // called on swapping the screen, textures drawn in the frame are kept
+      virtual bool next_frame() = 0;
+      virtual bool set_budget(long bytes) = 0;
   };
 
   class animation : public drawable
@@ -18,9 +18,11 @@
 #include "font.hpp"
 #include "fs.hpp"
 #include "image.hpp"
+#include "loader.hpp"
 #include "map.hpp"
 #include "package.hpp"
 #include "prim.hpp"
+#include "profiler.hpp"
 #include "screen.hpp"
 #include "sound.hpp"
 #include "string.hpp"
@@ -0,0 +1,111 @@
+#ifndef _LOADER_HPP
+#define _LOADER_HPP
+
+/////////////////////////////////////////////////////////////////////////////
+// Name:        lev/loader.hpp
+// Purpose:     header for asynchronous asset loading
+// Author:      Akiva Miura <akiva.miura@gmail.com>
+// Modified by:
+// Created:     10/17/2026
+// Copyright:   (C) 2010-2012 Akiva Miura
+// Licence:     MIT License
+/////////////////////////////////////////////////////////////////////////////
+
+#include "base.hpp"
+#include <boost/shared_ptr.hpp>
+#include <luabind/luabind.hpp>
+#include <string>
+
+extern "C" {
+  int luaopen_lev_loader(lua_State *L);
+}
+
+namespace lev
+{
+
+  // class dependencies
+  class sound;
+
+  class load_request : public base
+  {
+    public:
+      typedef boost::shared_ptr<load_request> ptr;
+    protected:
+      load_request() : base() { }
+    public:
+      virtual ~load_request() { }
+
+      virtual bool cancel() = 0;
+      virtual std::string get_kind() const = 0;
+      virtual luabind::object get_on_done() = 0;
+      virtual std::string get_path() const = 0;
+      virtual int get_priority() const = 0;
+      // 0 (queued) to 1 (delivered)
+      virtual double get_progress() const = 0;
+      // loaded object, nil until delivered
+      virtual luabind::object get_result() = 0;
+      virtual type_id get_type_id() const { return LEV_TLOAD_REQUEST; }
+      virtual bool is_canceled() const = 0;
+      virtual bool is_done() const = 0;
+      virtual bool is_failed() const = 0;
+      virtual bool set_on_done(luabind::object func) = 0;
+      virtual bool set_priority(int priority) = 0;
+  };
+
+  class loader : public base
+  {
+    public:
+      typedef boost::shared_ptr<loader> ptr;
+    protected:
+      loader() : base() { }
+    public:
+      virtual ~loader() { }
+
+      virtual bool cancel_all() = 0;
+      static loader::ptr get();
+      virtual int get_pending() const = 0;
+      // overall progress of the requests since the queue was last empty
+      virtual double get_progress() const = 0;
+      virtual int get_threads() const = 0;
+      virtual type_id get_type_id() const { return LEV_TLOADER; }
+      static loader::ptr init(lua_State *L, int threads = 2);
+      static loader::ptr init0(lua_State *L) { return init(L); }
+
+      // kind is one of "bitmap", "file" and "texture"
+      virtual load_request::ptr load(const std::string &kind, const std::string &path,
+                                     int priority = 0) = 0;
+      load_request::ptr load2(const std::string &kind, const std::string &path)
+      {
+        return load(kind, path);
+      }
+      load_request::ptr load_bitmap(const std::string &path, int priority = 0)
+      {
+        return load("bitmap", path, priority);
+      }
+      load_request::ptr load_bitmap1(const std::string &path) { return load_bitmap(path); }
+      load_request::ptr load_file(const std::string &path, int priority = 0)
+      {
+        return load("file", path, priority);
+      }
+      load_request::ptr load_file1(const std::string &path) { return load_file(path); }
+      // the file is read ahead, then opened on the given mixer slot
+      virtual load_request::ptr load_sound(boost::shared_ptr<sound> target,
+                                           const std::string &path, int priority = 0) = 0;
+      load_request::ptr load_sound2(boost::shared_ptr<sound> target, const std::string &path)
+      {
+        return load_sound(target, path);
+      }
+      load_request::ptr load_texture(const std::string &path, int priority = 0)
+      {
+        return load("texture", path, priority);
+      }
+      load_request::ptr load_texture1(const std::string &path) { return load_texture(path); }
+
+      // delivering the finished requests, called from system::do_event
+      virtual bool poll() = 0;
+  };
+
+}
+
+#endif // _LOADER_HPP
+
@@ -16,6 +16,7 @@
 #include "fs.hpp"
 #include <luabind/luabind.hpp>
 #include <string>
+#include <vector>
 
 extern "C" {
   int luaopen_lev_package(lua_State *L);
@@ -40,10 +41,17 @@ namespace lev
       static boost::shared_ptr<font> find_font0(lua_State *L);
       static luabind::object get_font_dirs(lua_State *L);
       static luabind::object get_font_list(lua_State *L);
+      // copies of the path and search lists, to resolve without touching lua
+      static bool get_lists(lua_State *L, std::vector<std::string> &paths,
+                            std::vector<std::string> &searches);
       static luabind::object get_path_list(lua_State *L);
       static luabind::object get_search_list(lua_State *L);
       static int require_l(lua_State *L);
       static file::ptr resolve(lua_State *L, const std::string &file);
+      // thread safe, for the asynchronous loader
+      static file::ptr resolve_in(const std::vector<std::string> &paths,
+                                  const std::vector<std::string> &searches,
+                                  const std::string &file);
 //      static filepath::ptr resolve(lua_State *L, const std::string &file);
       static bool set_default_font_dirs(lua_State *L);
   };
@@ -33,6 +33,9 @@ namespace lev
       color(unsigned char r = 0, unsigned char g = 0, unsigned char b = 0, unsigned char a = 255);
       color(unsigned long argb_code);
 
+      // overwriting in place, for reusing one color object per frame
+      bool assign(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+      bool assign_color(const color &c) { return assign(c.r, c.g, c.b, c.a); }
       color::ptr clone();
       static color::ptr create(unsigned char r, unsigned char g,
                                unsigned char b, unsigned char a);
@@ -0,0 +1,102 @@
+#ifndef _PROFILER_HPP
+#define _PROFILER_HPP
+
+/////////////////////////////////////////////////////////////////////////////
+// Name:        lev/profiler.hpp
+// Purpose:     header for frame profiling
+// Author:      Akiva Miura <akiva.miura@gmail.com>
+// Modified by:
+// Created:     10/17/2026
+// Copyright:   (C) 2010-2012 Akiva Miura
+// Licence:     MIT License
+/////////////////////////////////////////////////////////////////////////////
+
+#include "base.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <luabind/luabind.hpp>
+#include <string>
+
+extern "C" {
+  int luaopen_lev_profiler(lua_State *L);
+}
+
+// measuring the rest of the enclosing block as the named zone
+#define LEV_PROFILE_ZONE(name) \
+  static const int lev_profile_zone_id = lev::profiler::register_zone(name); \
+  lev::profile_scope lev_profile_scope(lev_profile_zone_id)
+
+namespace lev
+{
+
+  class profiler : public base
+  {
+    public:
+      typedef boost::shared_ptr<profiler> ptr;
+    protected:
+      profiler() : base() { }
+    public:
+      virtual ~profiler() { }
+
+      // zone stack of the main thread, for Lua
+      virtual bool begin_zone(const std::string &name) = 0;
+      virtual bool end_zone() = 0;
+
+      // closing the frame, called by system::run on each iteration
+      virtual bool end_frame() = 0;
+
+      static profiler::ptr get();
+      bool get_enabled() const { return is_enabled(); }
+      // milliseconds spent in the zone per frame, averaged over the kept frames
+      virtual double get_average(const std::string &zone) const = 0;
+      virtual long get_frames() const = 0;
+      // frame counts of the zone time by the buckets of get_limits (milliseconds)
+      virtual luabind::object get_histogram(lua_State *L, const std::string &zone) const = 0;
+      // milliseconds spent in the zone on the last frame
+      virtual double get_last(const std::string &zone) const = 0;
+      virtual luabind::object get_limits(lua_State *L) const = 0;
+      virtual type_id get_type_id() const { return LEV_TPROFILER; }
+      virtual luabind::object get_zones(lua_State *L) const = 0;
+
+      static bool is_enabled();
+      virtual bool is_overlaid() const = 0;
+      virtual bool is_tracing() const = 0;
+
+      // ticks of the performance counter
+      static boost::uint64_t now();
+      // recording a finished zone, callable from any thread
+      static bool record(int zone, boost::uint64_t begin, boost::uint64_t end);
+      static int register_zone(const std::string &name);
+
+      virtual bool reset() = 0;
+      // writing the traced zones in the chrome://tracing JSON format
+      virtual bool save_trace(const std::string &path) = 0;
+      virtual bool set_enabled(bool enable) = 0;
+      // drawing the frame graph on the debugger's screen
+      virtual bool set_overlaid(bool overlay) = 0;
+      virtual bool start_trace() = 0;
+      virtual bool stop_trace() = 0;
+  };
+
+  class profile_scope
+  {
+    public:
+      profile_scope(int zone) : zone(zone), begin(0)
+      {
+        if (profiler::is_enabled()) { begin = profiler::now(); }
+      }
+
+      ~profile_scope()
+      {
+        if (begin > 0) { profiler::record(zone, begin, profiler::now()); }
+      }
+
+    private:
+      int zone;
+      boost::uint64_t begin;
+  };
+
+}
+
+#endif // _PROFILER_HPP
+
@@ -38,12 +38,16 @@ namespace lev
       virtual bool close() = 0;
       static screen::ptr create(const char *title, int x, int y, int w, int h,
                                 const char *style = NULL);
+      // queues a textured quad to the sprite batch
+      virtual bool draw_quad(texture::ptr src, int dst_x, int dst_y, int w, int h,
+                             double tex_x, double tex_y, double tex_w, double tex_h,
+                             unsigned char alpha = 255) = 0;
 //      bool draw_point(point *pt);
 //      static int draw_points(lua_State *L);
       virtual bool enable_alpha_blending(bool enable = true) = 0;
       bool enable_alpha_blending0() { return enable_alpha_blending(); }
 //      bool fill_rect(int x, int y, int w, int h, color *filling);
-//      void flush();
+      virtual bool flush() = 0;
 //      bool print(const char *text);
       virtual long get_id() const = 0;
       virtual bool hide() = 0;
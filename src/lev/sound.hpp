@@ -37,6 +37,7 @@ namespace lev
       virtual double get_length() = 0;
       virtual float get_pan() const = 0;
       virtual double get_position() = 0;
+      virtual long get_underruns() const = 0;
       virtual double get_volume() const = 0;
       virtual type_id get_type_id() const { return LEV_TSOUND; }
       virtual bool is_playing() const = 0;
@@ -74,6 +75,8 @@ namespace lev
       bool activate0() { return activate(); }
       virtual bool clear_slot(int slot_num) = 0;
       static mixer::ptr get();
+      // length of the samples decoded ahead, in milliseconds
+      virtual int get_buffer_length() const = 0;
       virtual int get_channels() const = 0;
       virtual int get_freq() const = 0;
 
@@ -81,8 +84,10 @@ namespace lev
       sound::ptr get_slot0() { return get_slot(); }
 
       virtual type_id get_type_id() const { return LEV_TMIXER; }
+      virtual long get_underruns() const = 0;
       static mixer::ptr init();
       virtual bool is_active() const = 0;
+      virtual bool set_buffer_length(int ms) = 0;
 
       bool start() { return activate(true); }
       bool stop() { return activate(false); }
@@ -22,12 +22,31 @@ extern "C" {
 namespace lev
 {
 
+  // flat indices of the dispatched event types
+  enum event_slot
+  {
+    LEV_EVENT_NONE = -1,
+    LEV_EVENT_BUTTON_DOWN,
+    LEV_EVENT_BUTTON_UP,
+    LEV_EVENT_KEY_DOWN,
+    LEV_EVENT_KEY_UP,
+    LEV_EVENT_MOTION,
+    LEV_EVENT_QUIT,
+    LEV_EVENT_WHEEL,
+    LEV_EVENT_WINDOW,
+    LEV_EVENT_SLOTS
+  };
+
   class input
   {
     public:
       static const char *to_keyname(long code);
+      // event slot of the SDL event type, LEV_EVENT_NONE if not dispatched
+      static int to_slot(unsigned long type);
   };
 
+  // events passed to the callbacks are pooled and overwritten by the next ones,
+  // clone to keep an event beyond the callback
   class event : public base
   {
     public:
@@ -66,7 +85,9 @@ namespace lev
 
       // attach methods
       virtual bool attach(boost::shared_ptr<class debugger> d) = 0;
+      virtual bool attach(boost::shared_ptr<class loader> l) = 0;
       virtual bool attach(boost::shared_ptr<class screen> s) = 0;
+      // (re)scheduling the timer at its current deadline
       virtual bool attach(boost::shared_ptr<class timer> t) = 0;
 
       // close method
@@ -81,13 +102,20 @@ namespace lev
       virtual bool do_events() = 0;
 
       static system::ptr get();
+      // interpolation alpha between the last and the next fixed updates (0 to 1)
+      virtual double get_alpha() const = 0;
       virtual boost::shared_ptr<class debugger> get_debugger() = 0;
+      // target frame rate of run, 0 for no pacing
+      virtual double get_fps() const = 0;
 
       static lua_State *get_interpreter();
 
       virtual std::string get_name() const = 0;
       virtual luabind::object get_on_button_down() = 0;
       virtual luabind::object get_on_button_up() = 0;
+      // batched callback, receiving the list of all pending events on do_events,
+      // after each of them was passed to its own handler if any
+      virtual luabind::object get_on_events() = 0;
       virtual luabind::object get_on_idle() = 0;
       virtual luabind::object get_on_key_down() = 0;
       virtual luabind::object get_on_key_up() = 0;
@@ -99,19 +127,28 @@ namespace lev
       virtual luabind::object get_on_quit() = 0;
       virtual luabind::object get_on_right_down() = 0;
       virtual luabind::object get_on_right_up() = 0;
+      virtual luabind::object get_on_update() = 0;
       virtual double get_elapsed() const = 0;
       virtual type_id get_type_id() const { return LEV_TSYSTEM; }
+      // fixed timestep rate of on_update, 0 for no fixed updates
+      virtual double get_update_rate() const = 0;
 
       static boost::shared_ptr<system> init(lua_State *L);
 
+      // merging the consecutive motion events of a window into one
+      virtual bool is_coalescing_motion() const = 0;
       virtual bool is_debugging() const = 0;
       virtual bool is_running() const = 0;
+      virtual bool is_vsync() const = 0;
       virtual bool quit(bool force = false) = 0;
       bool quit0() { return quit(); }
       virtual bool run() = 0;
+      virtual bool set_coalescing_motion(bool coalesce = true) = 0;
+      virtual bool set_fps(double fps) = 0;
       virtual bool set_name(const std::string &name) = 0;
       virtual bool set_on_button_down(luabind::object func) = 0;
       virtual bool set_on_button_up(luabind::object func) = 0;
+      virtual bool set_on_events(luabind::object func) = 0;
       virtual bool set_on_idle(luabind::object func) = 0;
       virtual bool set_on_key_down(luabind::object func) = 0;
       virtual bool set_on_key_up(luabind::object func) = 0;
@@ -123,7 +160,10 @@ namespace lev
       virtual bool set_on_quit(luabind::object func) = 0;
       virtual bool set_on_right_down(luabind::object func) = 0;
       virtual bool set_on_right_up(luabind::object func) = 0;
+      virtual bool set_on_update(luabind::object func) = 0;
       virtual bool set_running(bool run = true) = 0;
+      virtual bool set_update_rate(double rate) = 0;
+      virtual bool set_vsync(bool enable = true) = 0;
       virtual boost::shared_ptr<class debugger> start_debug() = 0;
       virtual bool stop_debug() = 0;
   };
@@ -58,6 +58,8 @@ namespace lev
 
       virtual bool close() = 0;
       static boost::shared_ptr<timer> create(double interval = 1);
+      // system elapsed time of the next notification, negative if stopped
+      virtual double get_deadline() const = 0;
       virtual double get_interval() const = 0;
       virtual luabind::object get_notify() = 0;
       virtual type_id get_type_id() const { return LEV_TTIMER; }
@@ -84,6 +86,8 @@ namespace lev
       virtual ~clock() { }
 
       static boost::shared_ptr<clock> create(double freq = 50);
+      // elapsed part of the current interval (0 to 1), for interpolating between the ticks
+      virtual double get_alpha() const = 0;
       virtual double get_freq() const = 0;
       virtual type_id get_type_id() const { return LEV_TCLOCK; }
       virtual bool set_freq(double freq) = 0;
@@ -0,0 +1,576 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        src/loader.cpp
+// Purpose:     source for asynchronous asset loading
+// Author:      Akiva Miura <akiva.miura@gmail.com>
+// Modified by:
+// Created:     10/17/2026
+// Copyright:   (C) 2010-2012 Akiva Miura
+// Licence:     MIT License
+/////////////////////////////////////////////////////////////////////////////
+
+// pre-compiled header
+#include "prec.h"
+
+// declarations
+#include "lev/loader.hpp"
+
+// dependencies
+#include "lev/debug.hpp"
+#include "lev/entry.hpp"
+#include "lev/fs.hpp"
+#include "lev/image.hpp"
+#include "lev/package.hpp"
+#include "lev/sound.hpp"
+#include "lev/system.hpp"
+
+// libraries
+#include <boost/weak_ptr.hpp>
+#include <cstring>
+#include <luabind/luabind.hpp>
+#include <luabind/raw_policy.hpp>
+#include <SDL2/SDL.h>
+#include <vector>
+
+int luaopen_lev_loader(lua_State *L)
+{
+  using namespace luabind;
+  using namespace lev;
+
+  open(L);
+  // beginning to load
+  globals(L)["package"]["loaded"]["lev.loader"] = true;
+  // pre-requirement
+  globals(L)["require"]("lev.base");
+  globals(L)["require"]("lev.image");
+  globals(L)["require"]("lev.sound");
+
+  module(L, "lev")
+  [
+    namespace_("classes")
+    [
+      class_<load_request, base, base::ptr>("load_request")
+        .def("cancel", &load_request::cancel)
+        .property("done", &load_request::is_done)
+        .property("failed", &load_request::is_failed)
+        .property("is_canceled", &load_request::is_canceled)
+        .property("is_done", &load_request::is_done)
+        .property("is_failed", &load_request::is_failed)
+        .property("kind", &load_request::get_kind)
+        .property("on_done", &load_request::get_on_done, &load_request::set_on_done)
+        .property("path", &load_request::get_path)
+        .property("priority", &load_request::get_priority, &load_request::set_priority)
+        .property("progress", &load_request::get_progress)
+        .property("result", &load_request::get_result),
+      class_<loader, base, base::ptr>("loader")
+        .def("bitmap", &loader::load_bitmap)
+        .def("bitmap", &loader::load_bitmap1)
+        .def("cancel_all", &loader::cancel_all)
+        .def("file", &loader::load_file)
+        .def("file", &loader::load_file1)
+        .def("load", &loader::load)
+        .def("load", &loader::load2)
+        .property("pending", &loader::get_pending)
+        .def("poll", &loader::poll)
+        .property("progress", &loader::get_progress)
+        .def("sound", &loader::load_sound)
+        .def("sound", &loader::load_sound2)
+        .def("texture", &loader::load_texture)
+        .def("texture", &loader::load_texture1)
+        .property("threads", &loader::get_threads)
+        .scope
+        [
+          def("get", &loader::get),
+          def("init", &loader::init, raw(_1)),
+          def("init", &loader::init0, raw(_1))
+        ]
+    ]
+  ];
+  object lev = globals(L)["lev"];
+  object classes = lev["classes"];
+
+  lev["loader"] = classes["loader"]["init"];
+
+  // end of loading
+  globals(L)["package"]["loaded"]["lev.loader"] = true;
+  return 0;
+}
+
+namespace lev
+{
+
+  enum load_state
+  {
+    LOAD_QUEUED = 0,
+    LOAD_RUNNING,
+    LOAD_READY,
+    LOAD_DONE,
+    LOAD_FAILED,
+    LOAD_CANCELED
+  };
+
+  // load request implementation
+  // members without atomics are written by one worker before LOAD_READY,
+  // and are touched by the main thread only after seeing it
+  class impl_load_request : public load_request
+  {
+    public:
+      typedef boost::shared_ptr<impl_load_request> ptr;
+    protected:
+      impl_load_request() :
+        load_request(),
+        kind(), path(),
+        paths(), searches(),
+        seq(0),
+        bmp(), data(), target(),
+        on_done(), result()
+      {
+        SDL_AtomicSet(&state, LOAD_QUEUED);
+        SDL_AtomicSet(&progress, 0);
+        SDL_AtomicSet(&priority, 0);
+      }
+    public:
+      virtual ~impl_load_request() { }
+
+      virtual bool cancel()
+      {
+        if (SDL_AtomicCAS(&state, LOAD_QUEUED, LOAD_CANCELED)) { return true; }
+        if (SDL_AtomicCAS(&state, LOAD_RUNNING, LOAD_CANCELED)) { return true; }
+        if (SDL_AtomicCAS(&state, LOAD_READY, LOAD_CANCELED)) { return true; }
+        return false;
+      }
+
+      // on the main thread
+      bool complete(lua_State *L)
+      {
+        using namespace luabind;
+
+        if (SDL_AtomicGet(&state) != LOAD_READY) { return false; }
+        try {
+          if (kind == "bitmap")
+          {
+            result = object(L, bmp);
+          }
+          else if (kind == "texture")
+          {
+            // uploading on the GL thread
+            texture::ptr tex = texture::create(bmp);
+            if (! tex) { throw -1; }
+            result = object(L, tex);
+          }
+          else if (kind == "sound")
+          {
+            if (! target->open_file(data)) { throw -2; }
+            result = object(L, target);
+          }
+          else
+          {
+            result = object(L, data);
+          }
+        }
+        catch (...) {
+          SDL_AtomicCAS(&state, LOAD_READY, LOAD_FAILED);
+          return false;
+        }
+        bmp.reset();
+        data.reset();
+        target.reset();
+        SDL_AtomicSet(&progress, 1000);
+        return SDL_AtomicCAS(&state, LOAD_READY, LOAD_DONE);
+      }
+
+      static impl_load_request::ptr create(const std::string &kind, const std::string &path,
+                                           int priority)
+      {
+        impl_load_request::ptr req;
+        try {
+          req.reset(new impl_load_request);
+          if (! req) { throw -1; }
+          req->kind = kind;
+          req->path = path;
+          SDL_AtomicSet(&req->priority, priority);
+        }
+        catch (...) {
+          req.reset();
+          lev::debug_print("error on load request creation");
+        }
+        return req;
+      }
+
+      virtual std::string get_kind() const
+      {
+        return kind;
+      }
+
+      virtual luabind::object get_on_done()
+      {
+        return on_done;
+      }
+
+      virtual std::string get_path() const
+      {
+        return path;
+      }
+
+      virtual int get_priority() const
+      {
+        return SDL_AtomicGet((SDL_atomic_t *)&priority);
+      }
+
+      virtual double get_progress() const
+      {
+        return SDL_AtomicGet((SDL_atomic_t *)&progress) / 1000.0;
+      }
+
+      virtual luabind::object get_result()
+      {
+        return result;
+      }
+
+      int get_state() const
+      {
+        return SDL_AtomicGet((SDL_atomic_t *)&state);
+      }
+
+      virtual bool is_canceled() const
+      {
+        return get_state() == LOAD_CANCELED;
+      }
+
+      virtual bool is_done() const
+      {
+        return get_state() == LOAD_DONE;
+      }
+
+      virtual bool is_failed() const
+      {
+        return get_state() == LOAD_FAILED;
+      }
+
+      virtual bool set_on_done(luabind::object func)
+      {
+        on_done = func;
+        return true;
+      }
+
+      virtual bool set_priority(int new_priority)
+      {
+        SDL_AtomicSet(&priority, new_priority);
+        return true;
+      }
+
+      // on a worker thread, without touching lua
+      bool work()
+      {
+        if (! SDL_AtomicCAS(&state, LOAD_QUEUED, LOAD_RUNNING)) { return false; }
+        SDL_AtomicSet(&progress, 100);
+        try {
+          // reading the file, inflating if it is in an archive
+          file::ptr f = package::resolve_in(paths, searches, path);
+          if (! f) { throw -1; }
+          SDL_AtomicSet(&progress, 400);
+          if (is_canceled()) { return false; }
+
+          if (kind == "bitmap" || kind == "texture")
+          {
+            bmp = bitmap::load_file(f);
+            if (! bmp) { throw -2; }
+          }
+          else if (f->get_data())
+          {
+            // already in memory (mapped or extracted)
+            data = f;
+          }
+          else if (kind == "sound")
+          {
+            // decoded from the file itself, without holding it whole
+            data = f;
+          }
+          else
+          {
+            // read straight into the memory file
+            long size = f->get_size();
+            if (size < 0) { throw -3; }
+            memfile::ptr mem = memfile::create(size);
+            if (! mem) { throw -4; }
+            if (size > 0 && f->read(mem->get_buffer(), 1, size) != (size_t)size) { throw -5; }
+            data = mem;
+          }
+        }
+        catch (...) {
+          SDL_AtomicCAS(&state, LOAD_RUNNING, LOAD_FAILED);
+          return false;
+        }
+        SDL_AtomicSet(&progress, 900);
+        return SDL_AtomicCAS(&state, LOAD_RUNNING, LOAD_READY);
+      }
+
+      std::string kind, path;
+      std::vector<std::string> paths, searches;
+      long seq;
+      SDL_atomic_t state, progress, priority;
+      bitmap::ptr bmp;
+      file::ptr data;
+      sound::ptr target;
+      luabind::object on_done;
+      luabind::object result;
+  };
+
+
+  // loader implementation
+  class impl_loader : public loader
+  {
+    public:
+      typedef boost::shared_ptr<impl_loader> ptr;
+    protected:
+      impl_loader() :
+        loader(),
+        L(NULL),
+        mutex(NULL), wake(NULL), workers(),
+        queue(), finished(), tracked(),
+        next_seq(0)
+      {
+        SDL_AtomicSet(&running, 0);
+        SDL_AtomicSet(&ready, 0);
+      }
+    public:
+      virtual ~impl_loader()
+      {
+        stop_workers();
+        if (wake) { SDL_DestroySemaphore(wake); }
+        if (mutex) { SDL_DestroyMutex(mutex); }
+      }
+
+      virtual bool cancel_all()
+      {
+        for (int i = 0; i < tracked.size(); i++)
+        {
+          tracked[i]->cancel();
+        }
+        return true;
+      }
+
+      static impl_loader::ptr get()
+      {
+        return current.lock();
+      }
+
+      virtual int get_pending() const
+      {
+        int pending = 0;
+        for (int i = 0; i < tracked.size(); i++)
+        {
+          int state = tracked[i]->get_state();
+          if (state == LOAD_QUEUED || state == LOAD_RUNNING || state == LOAD_READY) { pending++; }
+        }
+        return pending;
+      }
+
+      virtual double get_progress() const
+      {
+        if (tracked.empty()) { return 1; }
+        double total = 0;
+        for (int i = 0; i < tracked.size(); i++)
+        {
+          int state = tracked[i]->get_state();
+          if (state == LOAD_DONE || state == LOAD_FAILED || state == LOAD_CANCELED) { total += 1; }
+          else { total += tracked[i]->get_progress(); }
+        }
+        return total / tracked.size();
+      }
+
+      virtual int get_threads() const
+      {
+        return workers.size();
+      }
+
+      static impl_loader::ptr init(lua_State *L, int threads)
+      {
+        impl_loader::ptr ldr = current.lock();
+        if (ldr) { return ldr; }
+        if (threads <= 0) { threads = 1; }
+        try {
+          ldr.reset(new impl_loader);
+          if (! ldr) { throw -1; }
+          ldr->L = L;
+          ldr->mutex = SDL_CreateMutex();
+          if (! ldr->mutex) { throw -2; }
+          ldr->wake = SDL_CreateSemaphore(0);
+          if (! ldr->wake) { throw -3; }
+          SDL_AtomicSet(&ldr->running, 1);
+          for (int i = 0; i < threads; i++)
+          {
+            SDL_Thread *th = SDL_CreateThread(impl_loader::worker_main, "lev.loader", ldr.get());
+            if (! th) { throw -4; }
+            ldr->workers.push_back(th);
+          }
+          // delivering on system::do_event
+          if (system::ptr sys = system::get()) { sys->attach(loader::ptr(ldr)); }
+          current = ldr;
+        }
+        catch (...) {
+          ldr.reset();
+          lev::debug_print("error on loader initialization");
+        }
+        return ldr;
+      }
+
+      virtual load_request::ptr load(const std::string &kind, const std::string &path,
+                                     int priority)
+      {
+        if (kind != "bitmap" && kind != "file" && kind != "texture") { return load_request::ptr(); }
+        return submit(impl_load_request::create(kind, path, priority));
+      }
+
+      virtual load_request::ptr load_sound(sound::ptr target, const std::string &path,
+                                           int priority)
+      {
+        if (! target) { return load_request::ptr(); }
+        impl_load_request::ptr req = impl_load_request::create("sound", path, priority);
+        if (! req) { return req; }
+        req->target = target;
+        return submit(req);
+      }
+
+      // picking the highest priority, the oldest among the same priority
+      impl_load_request::ptr pick()
+      {
+        impl_load_request::ptr req;
+        int best = -1;
+        SDL_LockMutex(mutex);
+        for (int i = 0; i < queue.size(); )
+        {
+          if (queue[i]->get_state() != LOAD_QUEUED)
+          {
+            // canceled while queued, released on the main thread
+            finished.push_back(queue[i]);
+            queue.erase(queue.begin() + i);
+            SDL_AtomicIncRef(&ready);
+            continue;
+          }
+          if (best < 0 ||
+              queue[i]->get_priority() > queue[best]->get_priority() ||
+              (queue[i]->get_priority() == queue[best]->get_priority() &&
+               queue[i]->seq < queue[best]->seq))
+          {
+            best = i;
+          }
+          i++;
+        }
+        if (best >= 0)
+        {
+          req = queue[best];
+          queue.erase(queue.begin() + best);
+        }
+        SDL_UnlockMutex(mutex);
+        return req;
+      }
+
+      virtual bool poll()
+      {
+        if (SDL_AtomicGet(&ready) == 0)
+        {
+          if (! tracked.empty() && get_pending() == 0) { tracked.clear(); }
+          return false;
+        }
+
+        std::vector<impl_load_request::ptr> delivering;
+        SDL_LockMutex(mutex);
+        delivering.swap(finished);
+        SDL_AtomicSet(&ready, 0);
+        SDL_UnlockMutex(mutex);
+
+        for (int i = 0; i < delivering.size(); i++)
+        {
+          impl_load_request::ptr req = delivering[i];
+          if (req->is_canceled()) { continue; }
+          req->complete(L);
+          if (req->on_done && luabind::type(req->on_done) == LUA_TFUNCTION)
+          {
+            try {
+              req->on_done(load_request::ptr(req));
+            }
+            catch (...) {
+              lev::debug_print(lua_tostring(L, -1));
+              lev::debug_print("error on load request delivering");
+            }
+          }
+        }
+        if (get_pending() == 0) { tracked.clear(); }
+        return true;
+      }
+
+      load_request::ptr submit(impl_load_request::ptr req)
+      {
+        if (! req) { return req; }
+        // copying the search lists, workers can't touch lua
+        if (! L || ! package::get_lists(L, req->paths, req->searches))
+        {
+          req->paths.assign(1, "./");
+          req->searches.assign(1, "");
+        }
+        req->seq = next_seq++;
+        SDL_LockMutex(mutex);
+        queue.push_back(req);
+        SDL_UnlockMutex(mutex);
+        tracked.push_back(req);
+        SDL_SemPost(wake);
+        return req;
+      }
+
+      bool stop_workers()
+      {
+        if (workers.empty()) { return false; }
+        SDL_AtomicSet(&running, 0);
+        for (int i = 0; i < workers.size(); i++) { SDL_SemPost(wake); }
+        for (int i = 0; i < workers.size(); i++) { SDL_WaitThread(workers[i], NULL); }
+        workers.clear();
+        return true;
+      }
+
+      static int worker_main(void *udata)
+      {
+        impl_loader *ldr = (impl_loader *)udata;
+        for ( ; ; )
+        {
+          SDL_SemWait(ldr->wake);
+          if (! SDL_AtomicGet(&ldr->running)) { break; }
+          impl_load_request::ptr req = ldr->pick();
+          if (! req) { continue; }
+          req->work();
+          // handing back even on failure, lua objects must be released on the main thread
+          SDL_LockMutex(ldr->mutex);
+          ldr->finished.push_back(req);
+          // dropping ours before poll() may release the last one
+          req.reset();
+          SDL_AtomicIncRef(&ldr->ready);
+          SDL_UnlockMutex(ldr->mutex);
+        }
+        return 0;
+      }
+
+      static boost::weak_ptr<impl_loader> current;
+      lua_State *L;
+      SDL_mutex *mutex;
+      SDL_sem *wake;
+      SDL_atomic_t running, ready;
+      std::vector<SDL_Thread *> workers;
+      // guarded by the mutex
+      std::vector<impl_load_request::ptr> queue, finished;
+      // main thread only
+      std::vector<impl_load_request::ptr> tracked;
+      long next_seq;
+  };
+  boost::weak_ptr<impl_loader> impl_loader::current;
+
+  loader::ptr loader::get()
+  {
+    return impl_loader::get();
+  }
+
+  loader::ptr loader::init(lua_State *L, int threads)
+  {
+    return impl_loader::init(L, threads);
+  }
+
+}
+
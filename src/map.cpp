@@ -43,7 +43,7 @@ namespace lev
           bool hovered;
           drawable::ptr img;
           drawable::ptr img_hover;
-          rect::ptr r;
+          rect r;
           luabind::object func_hover;
           luabind::object func_lsingle;
           unsigned char alpha;
@@ -86,11 +86,11 @@ namespace lev
           unsigned char a = (short(alpha) * item.alpha) / 255;
           if (item.hovered)
           {
-            item.img_hover->draw_on(dst, item.r->get_x() + x, item.r->get_y() + y, a);
+            item.img_hover->draw_on(dst, item.r.get_x() + x, item.r.get_y() + y, a);
           }
           else
           {
-            item.img->draw_on(dst, item.r->get_x() + x, item.r->get_y() + y, a);
+            item.img->draw_on(dst, item.r.get_x() + x, item.r.get_y() + y, a);
           }
         }
         return true;
@@ -102,7 +102,7 @@ namespace lev
         for (int i = 0; i < items.size(); i++)
         {
           const item_type &item = items[i];
-          int h = item.r->get_y() + item.r->get_h();
+          int h = item.r.get_y() + item.r.get_h();
           if (h > max) { max = h; }
         }
         return max;
@@ -114,7 +114,7 @@ namespace lev
         for (int i = 0; i < items.size(); i++)
         {
           const item_type &item = items[i];
-          int w = item.r->get_x() + item.r->get_w();
+          int w = item.r.get_x() + item.r.get_w();
           if (w > max) { max = w; }
         }
         return max;
@@ -124,13 +124,11 @@ namespace lev
       {
         if (! img) { return false; }
 
-        rect::ptr r = rect::create(x, y, img->get_w(), img->get_h());
-        if (! r) { return false; }
         items.push_back(item_type());
         item_type &item = items[items.size() - 1];
         item.img = img;
         item.img_hover = img;
-        item.r = r;
+        item.r.assign(x, y, img->get_w(), img->get_h());
         item.alpha = a;
         texturized = false;
         return true;
@@ -186,13 +184,11 @@ namespace lev
         if (! img) { return false; }
         if (! hover_img) { hover_img = img; }
 
-        rect::ptr r = rect::create(x, y, img->get_w(), img->get_h());
-        if (! r) { return false; }
         items.push_back(item_type());
         item_type &item = items[items.size() - 1];
         item.img = img;
         item.img_hover = hover_img;
-        item.r = r;
+        item.r.assign(x, y, img->get_w(), img->get_h());
         item.alpha = alpha;
         item.func_hover = on_hover;
         item.func_lsingle = on_lsingle;
@@ -262,7 +258,7 @@ namespace lev
           for (int i = items.size() - 1; i >= 0; i--)
           {
             item_type &item = items[i];
-            if (item.r->include(x, y))
+            if (item.r.include(x, y))
             {
               item.hovered = true;
               return true;
@@ -283,7 +279,7 @@ namespace lev
           for (int i = items.size() - 1; i >= 0; i--)
           {
             item_type &item = items[i];
-            if (item.r->include(x, y) && item.hovered)
+            if (item.r.include(x, y) && item.hovered)
             {
 printf("MAP HIT! ITEM(%d), X:%d Y:%d\n", i, x, y);
               if (item.func_lsingle && luabind::type(item.func_lsingle) == LUA_TFUNCTION)
@@ -310,7 +306,7 @@ printf("MAP HIT! ITEM(%d), X:%d Y:%d\n", i, x, y);
           for (int i = items.size() - 1; i >= 0; i--)
           {
             item_type &item = items[i];
-            if (item.r->include(x, y))
+            if (item.r.include(x, y))
             {
               if (! item.hovered)
               {
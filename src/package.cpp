@@ -86,16 +86,28 @@ namespace lev
     return 1;
   }
 
-  static int dobuffer(lua_State *L, const std::string &name, const std::string &data)
+  static int dobuffer(lua_State *L, const std::string &name, const char *data, size_t len)
   {
     lua_pushcfunction(L, traceback);
     int trace_pos = lua_gettop(L);
-    int result = luaL_loadbuffer(L, data.c_str(), data.length(), name.c_str())
+    int result = luaL_loadbuffer(L, data, len, name.c_str())
                || lua_pcall(L, 0, LUA_MULTRET, trace_pos);
     lua_remove(L, trace_pos);
     return result;
   }
 
+  // loading directly from mapped or memory files, reading others into a string
+  // returns -1 if the file can't be read
+  static int dofile_ptr(lua_State *L, const std::string &name, file::ptr f)
+  {
+    const unsigned char *view = f->get_data();
+    if (view) { return dobuffer(L, name, (const char *)view, f->get_size()); }
+
+    std::string data;
+    if (! f->read_all(data)) { return -1; }
+    return dobuffer(L, name, data.c_str(), data.length());
+  }
+
   static bool purge_path(std::string &path)
   {
     long double_slash = path.find("//", 1);
@@ -187,12 +199,9 @@ namespace lev
     file::ptr f = package::resolve(L, filename);
     if (f)
     {
-      std::string data;
-      if (! f->read_all(data))
-      {
-        return false;
-      }
-      if (dobuffer(L, filename.c_str(), data) != 0)
+      int result = dofile_ptr(L, filename, f);
+      if (result < 0) { return false; }
+      if (result != 0)
       {
         lev::debug_print(lua_tostring(L, -1));
         return false;
@@ -217,9 +226,9 @@ namespace lev
     file::ptr f = package::resolve(L, filename);
     if (f)
     {
-      std::string data;
-      if (! f->read_all(data)) { return 0; }
-      if (dobuffer(L, filename.c_str(), data) != 0)
+      int result = dofile_ptr(L, filename, f);
+      if (result < 0) { return 0; }
+      if (result != 0)
       {
         lev::debug_print(lua_tostring(L, -1));
         return 0;
@@ -368,9 +377,9 @@ namespace lev
     if (! f) { f = package::resolve(L, module + ".lua"); }
     if (f)
     {
-      std::string data;
-      if (! f->read_all(data)) { return 0; }
-      if (dobuffer(L, module.c_str(), data.c_str()))
+      int result = dofile_ptr(L, module, f);
+      if (result < 0) { return 0; }
+      if (result != 0)
       {
         lev::debug_print(lua_tostring(L, -1));
         lua_pushnil(L);
@@ -395,8 +404,8 @@ namespace lev
     }
   }
 
-//  filepath::ptr package::resolve(lua_State *L, const std::string &file)
-  file::ptr package::resolve(lua_State *L, const std::string &file)
+  bool package::get_lists(lua_State *L, std::vector<std::string> &paths,
+                          std::vector<std::string> &searches)
   {
     using namespace luabind;
 
@@ -404,62 +413,79 @@ namespace lev
       object path_list   = package::get_path_list(L);
       object search_list = package::get_search_list(L);
 
+      paths.clear();
+      searches.clear();
       for (iterator p(path_list), end; p != end; p++)
       {
-        std::string path = object_cast<const char *>(*p);
+        paths.push_back(object_cast<const char *>(*p));
+      }
+      for (iterator s(search_list), end; s != end; s++)
+      {
+        searches.push_back(object_cast<const char *>(*s));
+      }
+      return true;
+    }
+    catch (...) {
+      lev::debug_print("error on package list getting");
+    }
+    return false;
+  }
 
-        for (iterator s(search_list); s != end; s++)
-        {
-          std::string search = object_cast<const char *>(*s);
+//  filepath::ptr package::resolve(lua_State *L, const std::string &file)
+  file::ptr package::resolve(lua_State *L, const std::string &file)
+  {
+    std::vector<std::string> paths, searches;
+    if (! package::get_lists(L, paths, searches)) { return file::ptr(); }
+    return package::resolve_in(paths, searches, file);
+  }
+
+  file::ptr package::resolve_in(const std::vector<std::string> &paths,
+                                const std::vector<std::string> &searches,
+                                const std::string &file)
+  {
+    try {
+      for (int p = 0; p < paths.size(); p++)
+      {
+        const std::string &path = paths[p];
 
-          std::string real_path = path + "/" + search + "/" + file;
+        for (int s = 0; s < searches.size(); s++)
+        {
+          std::string real_path = path + "/" + searches[s] + "/" + file;
           purge_path(real_path);
 
           if (fs::is_file(real_path))
           {
+            file::ptr f = file::open_mapped(real_path);
+            if (f) { return f; }
             return file::open(real_path, "rb");
 //            return filepath::create(real_path);
           }
         }
 
-        if (lev::archive::is_archive(path))
+        // pooled handle, not to reopen the same archive for every lookup
+        archive::ptr arc = archive::open_shared(path);
+        if (arc)
         {
-          for (iterator s(search_list); s != end; s++)
+          for (int s = 0; s < searches.size(); s++)
           {
-            std::string entry = object_cast<const char *>(*s);
+            std::string entry = searches[s];
             if (entry.empty()) { entry = file; }
             else { entry = entry + "/" + file; }
-            if (archive::entry_exists_direct(path, entry))
+            if (arc->entry_exists(entry))
             {
-              std::string sys_name = ".";
-              if (system::get()) { sys_name = system::get()->get_name(); }
-              std::string ext = fs::to_extension(file);
-
-//              filepath::ptr fpath(filepath::create_temp(sys_name + "/", ext));
-//              if (! fpath) { return fpath; }
-//              lev::archive::extract_direct_to(path, entry, fpath->get_string());
-//              return fpath;
-              return archive::extract_direct(path, entry, NULL);
+              return arc->extract(entry);
             }
           }
 
           std::string arc_name = fs::to_stem(path);
-          for (iterator s(search_list); s != end; s++)
+          for (int s = 0; s < searches.size(); s++)
           {
-            std::string entry = object_cast<const char *>(*s);
+            std::string entry = searches[s];
             if (entry.empty()) { entry = arc_name + "/" + file; }
             else { entry = arc_name + "/" + entry + "/" + file; }
-            if (archive::entry_exists_direct(path, entry))
+            if (arc->entry_exists(entry))
             {
-              std::string sys_name = ".";
-              if (system::get()) { sys_name = system::get()->get_name(); }
-              std::string ext = fs::to_extension(file);
-
-//              filepath::ptr fpath(filepath::create_temp(sys_name + "/", ext));
-//              if (! fpath) { return fpath; }
-//              lev::archive::extract_direct_to(path, entry, fpath->get_string());
-//              return fpath;
-              return archive::extract_direct(path, entry, NULL);
+              return arc->extract(entry);
             }
           }
         }
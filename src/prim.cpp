@@ -31,6 +31,8 @@ int luaopen_lev_prim(lua_State *L)
     namespace_("classes")
     [
       class_<color, base, boost::shared_ptr<base> >("color")
+        .def("assign", &color::assign)
+        .def("assign", &color::assign_color)
         .property("a", &color::get_a, &color::set_a)
         .property("alpha", &color::get_a, &color::set_a)
         .property("b", &color::get_b, &color::set_b)
@@ -159,6 +161,18 @@ int luaopen_lev_prim(lua_State *L)
 namespace lev
 {
 
+  // plain numeric arguments, taken without building the merged table
+  static bool numbers_only(lua_State *L, int max)
+  {
+    int n = lua_gettop(L);
+    if (n > max) { return false; }
+    for (int i = 1; i <= n; i++)
+    {
+      if (lua_type(L, i) != LUA_TNUMBER) { return false; }
+    }
+    return true;
+  }
+
   color::color(const color &orig)
     : r(orig.r), g(orig.g), b(orig.b), a(orig.a) { }
 
@@ -174,6 +188,16 @@ namespace lev
     if (a == 0) { a = 255; }
   }
 
+  bool color::assign(unsigned char new_r, unsigned char new_g,
+                     unsigned char new_b, unsigned char new_a)
+  {
+    this->r = new_r;
+    this->g = new_g;
+    this->b = new_b;
+    this->a = new_a;
+    return true;
+  }
+
   boost::shared_ptr<color> color::clone()
   {
     boost::shared_ptr<color> c;
@@ -210,6 +234,17 @@ namespace lev
     unsigned char r = 0, g = 0, b = 0, a = 255;
     const char *name = NULL;
 
+    if (numbers_only(L, 4))
+    {
+      int n = lua_gettop(L);
+      if (n >= 1) { r = lua_tointeger(L, 1); }
+      if (n >= 2) { g = lua_tointeger(L, 2); }
+      if (n >= 3) { b = lua_tointeger(L, 3); }
+      if (n >= 4) { a = lua_tointeger(L, 4); }
+      object(L, color::create(r, g, b, a)).push(L);
+      return 1;
+    }
+
     object t = util::get_merged(L, 1, -1);
 
     if (t["name"]) { name = object_cast<const char *>(t["name"]); }
@@ -310,6 +345,16 @@ namespace lev
     using namespace luabind;
     int w = 0, h = 0, d = 0;
 
+    if (numbers_only(L, 3))
+    {
+      int n = lua_gettop(L);
+      if (n >= 1) { w = lua_tointeger(L, 1); }
+      if (n >= 2) { h = lua_tointeger(L, 2); }
+      if (n >= 3) { d = lua_tointeger(L, 3); }
+      object(L, size::create(w, h, d)).push(L);
+      return 1;
+    }
+
     object t = util::get_merged(L, 1, -1);
 
     if (t["width"]) { w = object_cast<int>(t["width"]); }
@@ -360,6 +405,16 @@ namespace lev
     using namespace luabind;
     int x = 0, y = 0, z = 0;
 
+    if (numbers_only(L, 3))
+    {
+      int n = lua_gettop(L);
+      if (n >= 1) { x = lua_tointeger(L, 1); }
+      if (n >= 2) { y = lua_tointeger(L, 2); }
+      if (n >= 3) { z = lua_tointeger(L, 3); }
+      object(L, vector::create(x, y, z)).push(L);
+      return 1;
+    }
+
     object t = util::get_merged(L, 1, -1);
 
     if (t["x"]) { x = object_cast<int>(t["x"]); }
@@ -548,6 +603,17 @@ namespace lev
     using namespace luabind;
     int x = 0, y = 0, w = 0, h = 0;
 
+    if (numbers_only(L, 4))
+    {
+      int n = lua_gettop(L);
+      if (n >= 1) { x = lua_tointeger(L, 1); }
+      if (n >= 2) { y = lua_tointeger(L, 2); }
+      if (n >= 3) { w = lua_tointeger(L, 3); }
+      if (n >= 4) { h = lua_tointeger(L, 4); }
+      object(L, rect::create(x, y, w, h)).push(L);
+      return 1;
+    }
+
     object t = util::get_merged(L, 1, -1);
 
     if (t["x"]) { x = object_cast<int>(t["x"]); }
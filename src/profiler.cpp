@@ -0,0 +1,602 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        src/profiler.cpp
+// Purpose:     source for frame profiling
+// Author:      Akiva Miura <akiva.miura@gmail.com>
+// Modified by:
+// Created:     10/17/2026
+// Copyright:   (C) 2010-2012 Akiva Miura
+// Licence:     MIT License
+/////////////////////////////////////////////////////////////////////////////
+
+// pre-compiled header
+#include "prec.h"
+
+// declarations
+#include "lev/profiler.hpp"
+
+// dependencies
+#include "lev/debug.hpp"
+#include "lev/entry.hpp"
+#include "lev/image.hpp"
+#include "lev/screen.hpp"
+#include "lev/system.hpp"
+
+// libraries
+#include <algorithm>
+#include <cstdio>
+#include <luabind/luabind.hpp>
+#include <luabind/raw_policy.hpp>
+#include <map>
+#include <SDL2/SDL.h>
+#include <vector>
+
+int luaopen_lev_profiler(lua_State *L)
+{
+  using namespace luabind;
+  using namespace lev;
+
+  open(L);
+  // beginning to load
+  globals(L)["package"]["loaded"]["lev.profiler"] = true;
+  // pre-requirement
+  globals(L)["require"]("lev.base");
+  globals(L)["require"]("lev.debug");
+
+  module(L, "lev")
+  [
+    namespace_("classes")
+    [
+      class_<profiler, base, base::ptr>("profiler")
+        .def("average", &profiler::get_average)
+        .def("begin_zone", &profiler::begin_zone)
+        .property("enabled", &profiler::get_enabled, &profiler::set_enabled)
+        .def("end_frame", &profiler::end_frame)
+        .def("end_zone", &profiler::end_zone)
+        .property("frames", &profiler::get_frames)
+        .def("get_limits", &profiler::get_limits, raw(_2))
+        .def("get_zones", &profiler::get_zones, raw(_2))
+        .def("histogram", &profiler::get_histogram, raw(_2))
+        .property("is_enabled", &profiler::get_enabled)
+        .property("is_tracing", &profiler::is_tracing)
+        .def("last", &profiler::get_last)
+        .property("overlay", &profiler::is_overlaid, &profiler::set_overlaid)
+        .def("reset", &profiler::reset)
+        .def("save_trace", &profiler::save_trace)
+        .def("start_trace", &profiler::start_trace)
+        .def("stop_trace", &profiler::stop_trace)
+        .scope
+        [
+          def("get", &profiler::get)
+        ]
+    ]
+  ];
+  object lev = globals(L)["lev"];
+  object classes = lev["classes"];
+
+  // measuring a function call, the zone is closed even on errors
+  load_to(classes["profiler"], "zone",
+          "return function(self, name, f, ...)\n"
+          "  self:begin_zone(name)\n"
+          "  local result = { pcall(f, ...) }\n"
+          "  self:end_zone()\n"
+          "  if not result[1] then error(result[2], 0) end\n"
+          "  return unpack(result, 2, table.maxn(result))\n"
+          "end\n");
+  lev["profiler"] = classes["profiler"]["get"];
+
+  // end of loading
+  globals(L)["package"]["loaded"]["lev.profiler"] = true;
+  return 0;
+}
+
+namespace lev
+{
+
+  class profiler_locker
+  {
+    public:
+      profiler_locker()
+      {
+        SDL_LockMutex(get_mutex());
+      }
+
+      ~profiler_locker()
+      {
+        SDL_UnlockMutex(get_mutex());
+      }
+
+      static SDL_mutex *get_mutex()
+      {
+        static SDL_mutex *mutex = SDL_CreateMutex();
+        return mutex;
+      }
+  };
+
+  // finished zones, written by any thread and read by the main thread on end_frame
+  class profile_ring
+  {
+    public:
+      enum
+      {
+        // must be a power of 2
+        CAPACITY = 1 << 14
+      };
+
+      struct event_type
+      {
+        int zone;
+        SDL_threadID thread;
+        boost::uint64_t begin, end;
+        // serial number + 1 of the written event, 0 while being written
+        SDL_atomic_t seq;
+      };
+
+    protected:
+      profile_ring() : events(CAPACITY), tail(0)
+      {
+        SDL_AtomicSet(&head, 0);
+        SDL_AtomicSet(&enabled, 0);
+        for (int i = 0; i < CAPACITY; i++) { SDL_AtomicSet(&events[i].seq, 0); }
+      }
+
+    public:
+      static profile_ring &get()
+      {
+        static profile_ring ring;
+        return ring;
+      }
+
+      bool push(int zone, boost::uint64_t begin, boost::uint64_t end)
+      {
+        // reserving the slot, then publishing it by the serial number
+        int n = SDL_AtomicAdd(&head, 1);
+        event_type &e = events[n & (CAPACITY - 1)];
+        SDL_AtomicSet(&e.seq, 0);
+        e.zone = zone;
+        e.thread = SDL_ThreadID();
+        e.begin = begin;
+        e.end = end;
+        SDL_AtomicSet(&e.seq, n + 1);
+        return true;
+      }
+
+      // taking the next published event, false if none (only from one reader)
+      bool pop(event_type &out)
+      {
+        for ( ; ; )
+        {
+          if (SDL_AtomicGet(&head) - tail <= 0) { return false; }
+          event_type &e = events[tail & (CAPACITY - 1)];
+          int seq = SDL_AtomicGet(&e.seq);
+          if (seq - (tail + 1) < 0 || seq == 0)
+          {
+            // reserved but not yet published
+            return false;
+          }
+          if (seq != tail + 1)
+          {
+            // overrun by the writers, skipping to the oldest kept event
+            tail = SDL_AtomicGet(&head) - CAPACITY + 1;
+            continue;
+          }
+          out.zone = e.zone;
+          out.thread = e.thread;
+          out.begin = e.begin;
+          out.end = e.end;
+          // the slot is reused while copying
+          if (SDL_AtomicGet(&e.seq) != seq) { continue; }
+          tail++;
+          return true;
+        }
+      }
+
+      std::vector<event_type> events;
+      SDL_atomic_t head;
+      int tail;
+      SDL_atomic_t enabled;
+  };
+
+  // zone names, ids are the indices
+  static std::vector<std::string> *zone_names = NULL;
+  static std::map<std::string, int> *zone_ids = NULL;
+
+  static std::string get_zone_name(int zone)
+  {
+    profiler_locker lock;
+    if (! zone_names || zone < 0 || zone >= zone_names->size()) { return ""; }
+    return (*zone_names)[zone];
+  }
+
+  static int get_zone_count()
+  {
+    profiler_locker lock;
+    if (! zone_names) { return 0; }
+    return zone_names->size();
+  }
+
+  static int find_zone(const std::string &name)
+  {
+    profiler_locker lock;
+    if (! zone_ids) { return -1; }
+    std::map<std::string, int>::iterator found = zone_ids->find(name);
+    if (found == zone_ids->end()) { return -1; }
+    return found->second;
+  }
+
+  class impl_profiler : public profiler
+  {
+    public:
+      typedef boost::shared_ptr<impl_profiler> ptr;
+
+      enum
+      {
+        // frames kept for the averages and the overlay
+        HISTORY = 120,
+        // frames between the overlay redraws
+        OVERLAY_INTERVAL = 10,
+        // events kept while tracing
+        TRACE_LIMIT = 1 << 20
+      };
+
+    protected:
+      impl_profiler() :
+        profiler(),
+        frames(0), frame_begin(0), frame_zone(-1),
+        graph(), overlaid(false),
+        stack(),
+        totals(), histories(), histograms(),
+        trace(), trace_begin(0), tracing(false)
+      { }
+    public:
+      virtual ~impl_profiler() { }
+
+      virtual bool begin_zone(const std::string &name)
+      {
+        if (! is_enabled()) { return false; }
+        stack.push_back(std::make_pair(register_zone(name), now()));
+        return true;
+      }
+
+      // accumulating the frame totals of the zone
+      bool collect(const profile_ring::event_type &e)
+      {
+        if (e.zone < 0) { return false; }
+        if (e.zone >= totals.size()) { grow(e.zone + 1); }
+        totals[e.zone] += e.end - e.begin;
+        if (tracing && trace.size() < TRACE_LIMIT) { trace.push_back(e); }
+        return true;
+      }
+
+      virtual bool end_frame()
+      {
+        if (! is_enabled()) { return false; }
+        boost::uint64_t t = now();
+        if (frame_begin > 0) { record(frame_zone, frame_begin, t); }
+        frame_begin = t;
+
+        profile_ring::event_type e;
+        while (profile_ring::get().pop(e)) { collect(e); }
+
+        const double freq = SDL_GetPerformanceFrequency();
+        const int slot = frames % HISTORY;
+        for (int i = 0; i < totals.size(); i++)
+        {
+          double ms = 1000.0 * totals[i] / freq;
+          histories[i][slot] = ms;
+          if (totals[i] > 0) { histograms[i][get_bucket(ms)]++; }
+          totals[i] = 0;
+        }
+        frames++;
+
+        if (overlaid && frames % OVERLAY_INTERVAL == 0) { draw_overlay(); }
+        return true;
+      }
+
+      virtual bool end_zone()
+      {
+        if (stack.empty()) { return false; }
+        record(stack.back().first, stack.back().second, now());
+        stack.pop_back();
+        return true;
+      }
+
+      bool draw_overlay()
+      {
+        system::ptr sys = system::get();
+        if (! sys || ! sys->get_debugger()) { return false; }
+        screen::ptr scr = sys->get_debugger()->get_screen();
+        if (! scr) { return false; }
+        try {
+          const int w = HISTORY * 2, h = 100;
+          if (! graph)
+          {
+            graph = bitmap::create(w, h);
+            if (! graph) { throw -1; }
+          }
+          graph->clear(0, 0, 0, 192);
+
+          // 100 pixels for 33.3 ms, the line is at 60 fps
+          const double scale = h / 33.3;
+          const color fast(64, 192, 64, 255);
+          const color slow(224, 64, 64, 255);
+          int zone = frame_zone;
+          if (zone >= 0 && zone < histories.size())
+          {
+            for (int i = 0; i < HISTORY && i < frames; i++)
+            {
+              double ms = histories[zone][(frames - 1 - i + HISTORY) % HISTORY];
+              int bar = std::min<int>(h, ms * scale);
+              graph->fill_rect(w - 2 * (i + 1), h - bar, 2, bar, ms > 16.7 ? slow : fast);
+            }
+          }
+          graph->fill_rect(0, h - int(16.7 * scale), w, 1, color(255, 255, 255, 255));
+
+          // redrawing the debug log under the graph
+          scr->set_current();
+          scr->clear();
+          layout::ptr lay = sys->get_debugger()->get_layout();
+          if (lay)
+          {
+            int y = 0;
+            if (lay->get_h() > scr->get_h()) { y = - (lay->get_h() - scr->get_h()); }
+            scr->draw(lay, 0, y, 255);
+          }
+          scr->blit(scr->get_w() - w, 0, graph);
+          scr->swap();
+        }
+        catch (...) {
+          lev::debug_print("error on profiler overlay drawing");
+          return false;
+        }
+        return true;
+      }
+
+      static impl_profiler::ptr get()
+      {
+        static impl_profiler::ptr prof;
+        if (prof) { return prof; }
+        try {
+          prof.reset(new impl_profiler);
+          if (! prof) { throw -1; }
+          prof->frame_zone = register_zone("frame");
+        }
+        catch (...) {
+          prof.reset();
+          lev::debug_print("error on profiler instance creation");
+        }
+        return prof;
+      }
+
+      virtual double get_average(const std::string &name) const
+      {
+        int zone = find_zone(name);
+        if (zone < 0 || zone >= histories.size() || frames == 0) { return 0; }
+        const int n = std::min<long>(frames, HISTORY);
+        double sum = 0;
+        for (int i = 0; i < n; i++) { sum += histories[zone][i]; }
+        return sum / n;
+      }
+
+      static int get_bucket(double ms)
+      {
+        const double *limits = get_limit_values();
+        int i = 0;
+        while (limits[i] > 0 && ms >= limits[i]) { i++; }
+        return i;
+      }
+
+      virtual long get_frames() const
+      {
+        return frames;
+      }
+
+      virtual luabind::object get_histogram(lua_State *L, const std::string &name) const
+      {
+        using namespace luabind;
+        object t = newtable(L);
+        int zone = find_zone(name);
+        for (int i = 0; i < get_bucket_count(); i++)
+        {
+          if (zone < 0 || zone >= histograms.size()) { t[i + 1] = 0; }
+          else { t[i + 1] = histograms[zone][i]; }
+        }
+        return t;
+      }
+
+      static int get_bucket_count()
+      {
+        const double *limits = get_limit_values();
+        int i = 0;
+        while (limits[i] > 0) { i++; }
+        // the last bucket is for the longer ones
+        return i + 1;
+      }
+
+      virtual double get_last(const std::string &name) const
+      {
+        int zone = find_zone(name);
+        if (zone < 0 || zone >= histories.size() || frames == 0) { return 0; }
+        return histories[zone][(frames - 1) % HISTORY];
+      }
+
+      // upper limits (milliseconds) of the histogram buckets, terminated by 0
+      static const double *get_limit_values()
+      {
+        static const double limits[] = { 0.1, 0.25, 0.5, 1, 2, 4, 8, 16.7, 33.3, 66.7, 0 };
+        return limits;
+      }
+
+      virtual luabind::object get_limits(lua_State *L) const
+      {
+        using namespace luabind;
+        object t = newtable(L);
+        const double *limits = get_limit_values();
+        for (int i = 0; limits[i] > 0; i++) { t[i + 1] = limits[i]; }
+        return t;
+      }
+
+      virtual luabind::object get_zones(lua_State *L) const
+      {
+        using namespace luabind;
+        object t = newtable(L);
+        const int count = get_zone_count();
+        for (int i = 0; i < count; i++) { t[i + 1] = get_zone_name(i); }
+        return t;
+      }
+
+      bool grow(int zones)
+      {
+        totals.resize(zones, 0);
+        histories.resize(zones, std::vector<double>(HISTORY, 0));
+        histograms.resize(zones, std::vector<long>(get_bucket_count(), 0));
+        return true;
+      }
+
+      virtual bool is_overlaid() const
+      {
+        return overlaid;
+      }
+
+      virtual bool is_tracing() const
+      {
+        return tracing;
+      }
+
+      virtual bool reset()
+      {
+        profile_ring::event_type e;
+        while (profile_ring::get().pop(e)) { }
+        frames = 0;
+        frame_begin = 0;
+        stack.clear();
+        totals.clear();
+        histories.clear();
+        histograms.clear();
+        trace.clear();
+        return true;
+      }
+
+      virtual bool save_trace(const std::string &path)
+      {
+        // the events of the current frame are not collected yet
+        profile_ring::event_type e;
+        while (profile_ring::get().pop(e)) { collect(e); }
+
+        FILE *out = fopen(path.c_str(), "w");
+        if (! out) { return false; }
+        const double freq = SDL_GetPerformanceFrequency();
+        fprintf(out, "{\"traceEvents\":[\n");
+        for (int i = 0; i < trace.size(); i++)
+        {
+          const profile_ring::event_type &ev = trace[i];
+          if (ev.begin < trace_begin) { continue; }
+          std::string name = get_zone_name(ev.zone);
+          std::string escaped;
+          for (int j = 0; j < name.size(); j++)
+          {
+            if (name[j] == '"' || name[j] == '\\') { escaped += '\\'; }
+            escaped += name[j];
+          }
+          fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,"
+                       "\"ts\":%.3f,\"dur\":%.3f}",
+                  i > 0 ? ",\n" : "", escaped.c_str(), (unsigned long)ev.thread,
+                  1000000.0 * (ev.begin - trace_begin) / freq,
+                  1000000.0 * (ev.end - ev.begin) / freq);
+        }
+        fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(out);
+        return true;
+      }
+
+      virtual bool set_enabled(bool enable)
+      {
+        if (enable == is_enabled()) { return true; }
+        SDL_AtomicSet(&profile_ring::get().enabled, enable ? 1 : 0);
+        // not to count the disabled period as a frame
+        frame_begin = 0;
+        stack.clear();
+        return true;
+      }
+
+      virtual bool set_overlaid(bool overlay)
+      {
+        overlaid = overlay;
+        return true;
+      }
+
+      virtual bool start_trace()
+      {
+        if (! is_enabled()) { set_enabled(true); }
+        trace.clear();
+        trace_begin = now();
+        tracing = true;
+        return true;
+      }
+
+      virtual bool stop_trace()
+      {
+        if (! tracing) { return false; }
+        profile_ring::event_type e;
+        while (profile_ring::get().pop(e)) { collect(e); }
+        tracing = false;
+        return true;
+      }
+
+      long frames;
+      boost::uint64_t frame_begin;
+      int frame_zone;
+      bitmap::ptr graph;
+      bool overlaid;
+      // zones opened from Lua
+      std::vector<std::pair<int, boost::uint64_t> > stack;
+      // per zone: ticks of the current frame, milliseconds of the kept frames, histogram
+      std::vector<boost::uint64_t> totals;
+      std::vector<std::vector<double> > histories;
+      std::vector<std::vector<long> > histograms;
+      std::vector<profile_ring::event_type> trace;
+      boost::uint64_t trace_begin;
+      bool tracing;
+  };
+
+  profiler::ptr profiler::get()
+  {
+    return impl_profiler::get();
+  }
+
+  bool profiler::is_enabled()
+  {
+    return SDL_AtomicGet(&profile_ring::get().enabled) != 0;
+  }
+
+  boost::uint64_t profiler::now()
+  {
+    return SDL_GetPerformanceCounter();
+  }
+
+  bool profiler::record(int zone, boost::uint64_t begin, boost::uint64_t end)
+  {
+    if (! is_enabled()) { return false; }
+    if (zone < 0) { return false; }
+    return profile_ring::get().push(zone, begin, end);
+  }
+
+  int profiler::register_zone(const std::string &name)
+  {
+    profiler_locker lock;
+    try {
+      if (! zone_names) { zone_names = new std::vector<std::string>; }
+      if (! zone_ids) { zone_ids = new std::map<std::string, int>; }
+      std::map<std::string, int>::iterator found = zone_ids->find(name);
+      if (found != zone_ids->end()) { return found->second; }
+      int id = zone_names->size();
+      zone_names->push_back(name);
+      (*zone_ids)[name] = id;
+      return id;
+    }
+    catch (...) {
+      return -1;
+    }
+  }
+
+}
+
@@ -19,6 +19,7 @@
 // dependencies
 #include "lev/debug.hpp"
 #include "lev/entry.hpp"
+#include "lev/profiler.hpp"
 #include "lev/system.hpp"
 #include "lev/util.hpp"
 
@@ -32,6 +33,40 @@
 namespace lev
 {
 
+  // sprite batch entries, drawn with client-side vertex arrays
+  struct quad_vertex
+  {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte r, g, b, a;
+  };
+
+  struct quad_run
+  {
+    texture::ptr tex;
+    GLuint index;
+    GLint first;
+    GLsizei count;
+  };
+
+  // primitive spans, drawn as one array of untextured quads
+  struct span_vertex
+  {
+    GLfloat x, y;
+    GLubyte r, g, b, a;
+  };
+
+  // texture reused for drawing non-texturized bitmaps
+  struct stream_texture
+  {
+    boost::weak_ptr<bitmap> src;
+    GLuint index;
+    int tex_w, tex_h;
+    unsigned long stamp;
+    unsigned long last_used;
+    bool queued;
+  };
+
   class impl_screen : public screen
   {
     public:
@@ -42,15 +77,24 @@ namespace lev
         screen(),
         win(NULL),
         context(NULL),
-        event_funcs(), win_funcs(),
+        event_funcs(), on_close(),
         on_left_down(), on_left_up(),
         on_middle_down(), on_middle_up(),
         on_right_down(), on_right_up(),
-        on_wheel(), on_wheel_down(), on_wheel_up()
+        on_wheel(), on_wheel_down(), on_wheel_up(),
+        quad_vertices(), quad_runs(), span_vertices(),
+        streams(), stream_clock(0)
         { }
     public:
+      // flushing automatically when this number of quads are queued
+      enum { MAX_BATCH_QUADS = 4096 };
+      // number of streaming textures kept for non-texturized bitmaps
+      enum { MAX_STREAM_TEXTURES = 8 };
+
       virtual ~impl_screen()
       {
+        discard_batch();
+        release_streams();
         if (context)
         {
           SDL_GL_DeleteContext(context);
@@ -70,6 +114,12 @@ namespace lev
         if (src == NULL) { return false; }
         if (src->is_texturized())
         {
+          if (src->is_texture_dirty())
+          {
+            // pending quads are drawn with the contents before the update
+            if (batch_uses(src->get_texture()->get_index())) { flush(); }
+            src->update_texture();
+          }
           return blit(dst_x, dst_y, src->get_texture(), src_x, src_y, w, h, alpha);
         }
 
@@ -77,29 +127,19 @@ namespace lev
         int src_w = src->get_w();
         if (w < 0) { w = src_w; }
         if (h < 0) { h = src_h; }
-        glBegin(GL_POINTS);
-          for (int y = 0; y < h; y++)
-          {
-            for (int x = 0; x < w; x++)
-            {
-              int real_src_x = src_x + x;
-              int real_src_y = src_y + y;
-              if (real_src_x < 0 || real_src_x >= src_w || real_src_y < 0 || real_src_y >= src_h)
-              {
-                continue;
-              }
-              color::ptr pixel(src->get_pixel(real_src_x, real_src_y));
-              if (! pixel) { continue; }
-              unsigned char a = (unsigned short)pixel->get_a() * alpha / 255;
-              if (a > 0)
-              {
-                glColor4ub(pixel->get_r(), pixel->get_g(), pixel->get_b(), a);
-                glVertex2i(dst_x + x, dst_y + y);
-              }
-            }
-          }
-        glEnd();
-        return true;
+        // clipping by the source bitmap
+        if (src_x < 0) { dst_x -= src_x; w += src_x; src_x = 0; }
+        if (src_y < 0) { dst_y -= src_y; h += src_y; src_y = 0; }
+        if (src_x + w > src_w) { w = src_w - src_x; }
+        if (src_y + h > src_h) { h = src_h - src_y; }
+        if (w <= 0 || h <= 0) { return true; }
+
+        stream_texture *st = update_stream(src);
+        if (! st) { return false; }
+        st->queued = true;
+        return queue_quad(texture::ptr(), st->index, dst_x, dst_y, w, h,
+                          double(src_x) / st->tex_w, double(src_y) / st->tex_h,
+                          double(w) / st->tex_w, double(h) / st->tex_h, alpha);
       }
 
       virtual bool blit(int dst_x, int dst_y, texture::ptr src,
@@ -111,6 +151,8 @@ namespace lev
       virtual bool clear(unsigned char r, unsigned char g,
                          unsigned char b, unsigned char a)
       {
+        // queued quads would be wiped out anyway
+        discard_batch();
         set_current();
         glClearColor(r / 255.0, g / 255.0, b / 255.0, a / 255.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -120,6 +162,8 @@ namespace lev
 
       virtual bool close()
       {
+        discard_batch();
+        release_streams();
         if (context)
         {
           SDL_GL_DeleteContext(context);
@@ -163,7 +207,7 @@ namespace lev
           s->context = SDL_GL_CreateContext(s->win);
           if (! s->context) { throw -3; }
 
-          SDL_GL_SetSwapInterval(0);
+          SDL_GL_SetSwapInterval(sys->is_vsync() ? 1 : 0);
     //      glMatrixMode(GL_PROJECTION);
     //      glLoadIdentity();
     //      glOrtho(0.0f, 640, 480, 0.0f, 0.0f, 1000.0f);
@@ -227,6 +271,23 @@ namespace lev
         }
       }
 
+      bool batch_uses(GLuint index) const
+      {
+        for (int i = 0; i < quad_runs.size(); i++)
+        {
+          if (quad_runs[i].index == index) { return true; }
+        }
+        return false;
+      }
+
+      bool discard_batch()
+      {
+        quad_vertices.clear();
+        quad_runs.clear();
+        for (int i = 0; i < streams.size(); i++) { streams[i].queued = false; }
+        return true;
+      }
+
       virtual bool draw(drawable::ptr src, int x, int y, unsigned char alpha)
       {
 //printf("SCREEN DRAW!\n");
@@ -239,6 +300,7 @@ namespace lev
 
       virtual bool draw_pixel(int x, int y, const color &c)
       {
+        flush();
         glBegin(GL_POINTS);
           glColor4ub(c.get_r(), c.get_g(), c.get_b(), c.get_a());
           glVertex2i(x, y);
@@ -269,8 +331,20 @@ namespace lev
 //        return true;
 //      }
 
+      virtual bool draw_quad(texture::ptr src, int dst_x, int dst_y, int w, int h,
+                             double tex_x, double tex_y, double tex_w, double tex_h,
+                             unsigned char alpha)
+      {
+        if (! src) { return false; }
+        // restoring the texture if evicted by the texture manager
+        if (! src->touch()) { return false; }
+        return queue_quad(src, src->get_index(), dst_x, dst_y, w, h,
+                          tex_x, tex_y, tex_w, tex_h, alpha);
+      }
+
       virtual bool enable_alpha_blending(bool enable)
       {
+        flush();
         set_current();
         if (enable)
         {
@@ -284,6 +358,74 @@ namespace lev
         return true;
       }
 
+      virtual bool fill_spans(const std::vector<span> &spans, const color &filling)
+      {
+        if (spans.empty()) { return true; }
+        flush();
+        if (! set_current()) { return false; }
+        LEV_PROFILE_ZONE("draw");
+
+        // one quad per span, all of them in a single draw call
+        span_vertices.resize(4 * spans.size());
+        for (int i = 0; i < spans.size(); i++)
+        {
+          const span &s = spans[i];
+          GLubyte a = (unsigned short)filling.get_a() * s.coverage / 255;
+          span_vertex *v = &span_vertices[4 * i];
+          for (int j = 0; j < 4; j++)
+          {
+            v[j].r = filling.get_r();
+            v[j].g = filling.get_g();
+            v[j].b = filling.get_b();
+            v[j].a = a;
+          }
+          v[0].x = s.x;       v[0].y = s.y;
+          v[1].x = s.x + s.w; v[1].y = s.y;
+          v[2].x = s.x + s.w; v[2].y = s.y + 1;
+          v[3].x = s.x;       v[3].y = s.y + 1;
+        }
+
+        const span_vertex *v = &span_vertices[0];
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, GL_FLOAT, sizeof(span_vertex), &v->x);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(span_vertex), &v->r);
+        glDrawArrays(GL_QUADS, 0, span_vertices.size());
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        return true;
+      }
+
+      virtual bool flush()
+      {
+        if (quad_vertices.empty()) { return true; }
+        if (! set_current())
+        {
+          discard_batch();
+          return false;
+        }
+        LEV_PROFILE_ZONE("draw");
+
+        const quad_vertex *v = &quad_vertices[0];
+        glEnable(GL_TEXTURE_2D);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, GL_FLOAT, sizeof(quad_vertex), &v->x);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(quad_vertex), &v->u);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(quad_vertex), &v->r);
+        for (int i = 0; i < quad_runs.size(); i++)
+        {
+          glBindTexture(GL_TEXTURE_2D, quad_runs[i].index);
+          glDrawArrays(GL_QUADS, quad_runs[i].first, quad_runs[i].count);
+        }
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisable(GL_TEXTURE_2D);
+        return discard_batch();
+      }
+
       virtual int get_h() const
       {
         if (! win) { return 0; }
@@ -301,19 +443,19 @@ namespace lev
       virtual luabind::object get_on_close()
       {
         if (! win) { return luabind::object(); }
-        return win_funcs[SDL_WINDOWEVENT_CLOSE];
+        return on_close;
       }
 
       virtual luabind::object get_on_key_down()
       {
         if (! win) { return luabind::object(); }
-        return event_funcs[SDL_KEYDOWN];
+        return event_funcs[LEV_EVENT_KEY_DOWN];
       }
 
       virtual luabind::object get_on_key_up()
       {
         if (! win) { return luabind::object(); }
-        return event_funcs[SDL_KEYUP];
+        return event_funcs[LEV_EVENT_KEY_UP];
       }
 
       virtual luabind::object get_on_left_down()
@@ -343,7 +485,7 @@ namespace lev
       virtual luabind::object get_on_motion()
       {
         if (! win) { return luabind::object(); }
-        return event_funcs[SDL_MOUSEMOTION];
+        return event_funcs[LEV_EVENT_MOTION];
       }
 
       virtual luabind::object get_on_right_down()
@@ -361,7 +503,7 @@ namespace lev
       virtual luabind::object get_on_wheel()
       {
         if (! win) { return luabind::object(); }
-        return event_funcs[SDL_MOUSEWHEEL];
+        return event_funcs[LEV_EVENT_WHEEL];
       }
 
       virtual luabind::object get_on_wheel_down()
@@ -380,6 +522,7 @@ namespace lev
       {
         bitmap::ptr img;
         if (! win) { return img; }
+        flush();
         set_current();
         try {
           if (get_id() > 0)
@@ -444,6 +587,7 @@ namespace lev
         {
           int w = get_w();
           int h = get_h();
+          flush();
           set_current();
           glLoadIdentity();
           glOrtho(0, w, h, 0, -1, 1);
@@ -456,6 +600,7 @@ namespace lev
       {
         if (win)
         {
+          flush();
           set_current();
           glLoadIdentity();
           glOrtho(left, right, bottom, top, -1, 1);
@@ -464,6 +609,54 @@ namespace lev
         return false;
       }
 
+      // src is kept alive until the quad is drawn, it may be empty for the
+      // textures owned by the screen
+      bool queue_quad(texture::ptr src, GLuint index, int dst_x, int dst_y, int w, int h,
+                      double tex_x, double tex_y, double tex_w, double tex_h,
+                      unsigned char alpha)
+      {
+        if (! win) { return false; }
+
+        if (quad_runs.empty() || quad_runs.back().index != index)
+        {
+          // consecutive quads of the same texture are merged into a draw call,
+          // they are never reordered to keep the blending order
+          quad_run run;
+          run.tex = src;
+          run.index = index;
+          run.first = quad_vertices.size();
+          run.count = 0;
+          quad_runs.push_back(run);
+        }
+
+        quad_vertex v;
+        v.r = v.g = v.b = 255;
+        v.a = alpha;
+        v.x = dst_x;     v.y = dst_y;     v.u = tex_x;         v.v = tex_y;
+        quad_vertices.push_back(v);
+        v.x = dst_x;     v.y = dst_y + h; v.u = tex_x;         v.v = tex_y + tex_h;
+        quad_vertices.push_back(v);
+        v.x = dst_x + w; v.y = dst_y + h; v.u = tex_x + tex_w; v.v = tex_y + tex_h;
+        quad_vertices.push_back(v);
+        v.x = dst_x + w; v.y = dst_y;     v.u = tex_x + tex_w; v.v = tex_y;
+        quad_vertices.push_back(v);
+        quad_runs.back().count += 4;
+
+        if (quad_vertices.size() >= 4 * MAX_BATCH_QUADS) { return flush(); }
+        return true;
+      }
+
+      bool release_streams()
+      {
+        if (streams.empty()) { return true; }
+        if (set_current())
+        {
+          for (int i = 0; i < streams.size(); i++) { glDeleteTextures(1, &streams[i].index); }
+        }
+        streams.clear();
+        return true;
+      }
+
       virtual bool set_current()
       {
         if (win)
@@ -496,21 +689,21 @@ namespace lev
       virtual bool set_on_close(luabind::object func)
       {
         if (! win) { return false; }
-        win_funcs[SDL_WINDOWEVENT_CLOSE] = func;
+        on_close = func;
         return true;
       }
 
       virtual bool set_on_key_down(luabind::object func)
       {
         if (! win) { return false; }
-        event_funcs[SDL_KEYDOWN] = func;
+        event_funcs[LEV_EVENT_KEY_DOWN] = func;
         return true;
       }
 
       virtual bool set_on_key_up(luabind::object func)
       {
         if (! win) { return false; }
-        event_funcs[SDL_KEYUP] = func;
+        event_funcs[LEV_EVENT_KEY_UP] = func;
         return true;
       }
 
@@ -545,7 +738,7 @@ namespace lev
       virtual bool set_on_motion(luabind::object func)
       {
         if (! win) { return false; }
-        event_funcs[SDL_MOUSEMOTION] = func;
+        event_funcs[LEV_EVENT_MOTION] = func;
         return true;
       }
 
@@ -566,7 +759,7 @@ namespace lev
       virtual bool set_on_wheel(luabind::object func)
       {
         if (! win) { return false; }
-        event_funcs[SDL_MOUSEWHEEL] = func;
+        event_funcs[LEV_EVENT_WHEEL] = func;
         return true;
       }
 
@@ -608,12 +801,107 @@ namespace lev
         if (win)
         {
           if (get_id() < 0) { return false; }
+          flush();
+          LEV_PROFILE_ZONE("swap");
           SDL_GL_SwapWindow(win);
+          texture_manager::ptr textures = texture_manager::get();
+          if (textures) { textures->next_frame(); }
           return true;
         }
         return false;
       }
 
+      // finds or assigns the streaming texture for src, and uploads the rows
+      // modified since the last upload
+      stream_texture *update_stream(bitmap::ptr src)
+      {
+        if (! set_current()) { return NULL; }
+        LEV_PROFILE_ZONE("texture_upload");
+        stream_clock++;
+
+        stream_texture *st = NULL;
+        for (int i = 0; i < streams.size(); i++)
+        {
+          if (streams[i].src.lock() == src)
+          {
+            st = &streams[i];
+            break;
+          }
+        }
+
+        int w = src->get_w();
+        int h = src->get_h();
+        bool full = false;
+        if (! st)
+        {
+          if (streams.size() < MAX_STREAM_TEXTURES)
+          {
+            stream_texture new_st;
+            new_st.index = 0;
+            glGenTextures(1, &new_st.index);
+            if (new_st.index == 0) { return NULL; }
+            new_st.tex_w = new_st.tex_h = 0;
+            new_st.queued = false;
+            streams.push_back(new_st);
+            st = &streams.back();
+          }
+          else
+          {
+            // reusing the least recently used one
+            st = &streams[0];
+            for (int i = 1; i < streams.size(); i++)
+            {
+              if (streams[i].last_used < st->last_used) { st = &streams[i]; }
+            }
+          }
+          st->src = src;
+          full = true;
+        }
+        st->last_used = stream_clock;
+
+        if (! full && st->stamp == src->get_stamp()) { return st; }
+        // rewriting the texture still drawn by the pending quads
+        if (st->queued) { flush(); }
+
+        glBindTexture(GL_TEXTURE_2D, st->index);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (st->tex_w < w || st->tex_h < h)
+        {
+          int tex_w = 1, tex_h = 1;
+          while (tex_w < w) { tex_w <<= 1; }
+          while (tex_h < h) { tex_h <<= 1; }
+          if (tex_w < st->tex_w) { tex_w = st->tex_w; }
+          if (tex_h < st->tex_h) { tex_h = st->tex_h; }
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+          glTexImage2D(GL_TEXTURE_2D, 0 /* level */, GL_RGBA, tex_w, tex_h, 0 /* border */,
+                       GL_RGBA, GL_UNSIGNED_BYTE, NULL /* only buffer reservation */);
+          st->tex_w = tex_w;
+          st->tex_h = tex_h;
+        }
+
+        const unsigned char *buf = src->get_buffer();
+        if (full)
+        {
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf);
+        }
+        else
+        {
+          // uploading each run of the dirty rows
+          int y = 0;
+          while (y < h)
+          {
+            if (src->get_row_stamp(y) <= st->stamp) { y++; continue; }
+            int top = y;
+            while (y < h && src->get_row_stamp(y) > st->stamp) { y++; }
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, top, w, y - top,
+                            GL_RGBA, GL_UNSIGNED_BYTE, buf + 4 * w * top);
+          }
+        }
+        st->stamp = src->get_stamp();
+        return st;
+      }
+
       virtual canvas::ptr to_canvas()
       {
         return canvas::ptr(wptr);
@@ -627,12 +915,18 @@ namespace lev
       boost::weak_ptr<impl_screen> wptr;
       SDL_GLContext context;
       SDL_Window *win;
-      std::map<Uint8, luabind::object> win_funcs;
-      std::map<Uint32, luabind::object> event_funcs;
+      // callbacks indexed by the event slot
+      luabind::object event_funcs[LEV_EVENT_SLOTS];
+      luabind::object on_close;
       luabind::object on_left_down, on_left_up;
       luabind::object on_middle_down, on_middle_up;
       luabind::object on_right_down, on_right_up;
       luabind::object on_wheel, on_wheel_down, on_wheel_up;
+      std::vector<quad_vertex> quad_vertices;
+      std::vector<quad_run> quad_runs;
+      std::vector<span_vertex> span_vertices;
+      std::vector<stream_texture> streams;
+      unsigned long stream_clock;
   };
 
   static SDL_GLContext cast_ctx(void *obj) { return (SDL_GLContext)obj; }
@@ -742,6 +1036,7 @@ int luaopen_lev_screen(lua_State *L)
         .def("enable_alpha_blending", &screen::enable_alpha_blending0)
         .def("enable_alpha_blending", &screen::enable_alpha_blending)
         .def("flip", &screen::swap)
+        .def("flush", &screen::flush)
         .def("get_screen_shot", &screen::get_screenshot)
         .def("get_screenshot", &screen::get_screenshot)
         .property("h", &screen::get_h, &screen::set_h)
@@ -61,11 +61,13 @@ int luaopen_lev_sound(lua_State *L)
         .def("play", &sound::play0)
         .property("pos", &sound::get_position, &sound::set_position)
         .property("position", &sound::get_position, &sound::set_position)
+        .property("underruns", &sound::get_underruns)
         .property("vol", &sound::get_volume, &sound::set_volume)
         .property("volume", &sound::get_volume, &sound::set_volume),
       class_<mixer, base, base::ptr>("mixer")
         .def("activate", &mixer::activate)
         .def("activate", &mixer::activate0)
+        .property("buffer_length", &mixer::get_buffer_length, &mixer::set_buffer_length)
         .def("clear_slot", &mixer::clear_slot)
         .property("channels", &mixer::get_channels)
         .property("freq", &mixer::get_freq)
@@ -75,6 +77,7 @@ int luaopen_lev_sound(lua_State *L)
         .def("slot", &mixer::get_slot0)
         .def("start", &mixer::start)
         .def("stop", &mixer::stop)
+        .property("underruns", &mixer::get_underruns)
         .scope
         [
           def("get", &mixer::get),
@@ -111,6 +114,104 @@ namespace lev
       }
   };
 
+  // guards the sound loaders and the slots from the decoder thread,
+  // take this before audio_locker when both are needed
+  class decoder_locker
+  {
+    public:
+      decoder_locker()
+      {
+        SDL_LockMutex(get_mutex());
+      }
+
+      ~decoder_locker()
+      {
+        SDL_UnlockMutex(get_mutex());
+      }
+
+      static SDL_mutex *get_mutex()
+      {
+        static SDL_mutex *mutex = SDL_CreateMutex();
+        return mutex;
+      }
+  };
+
+  // single producer (decoder thread), single consumer (audio callback)
+  // lock-free byte ring, one frame is always left empty
+  class sample_ring
+  {
+    public:
+      sample_ring() : buf(), capacity(0), frame(1)
+      {
+        SDL_AtomicSet(&read_pos, 0);
+        SDL_AtomicSet(&write_pos, 0);
+      }
+
+      int get_filled()
+      {
+        int r = SDL_AtomicGet(&read_pos);
+        int w = SDL_AtomicGet(&write_pos);
+        return w >= r ? w - r : w + capacity - r;
+      }
+
+      // contiguous writable region, for decoding into directly
+      int get_writable(Uint8 **ptr)
+      {
+        if (capacity == 0) { return 0; }
+        int r = SDL_AtomicGet(&read_pos);
+        int w = SDL_AtomicGet(&write_pos);
+        int len = (r > w ? r : r + capacity) - w - frame;
+        if (w + len > capacity) { len = capacity - w; }
+        *ptr = buf.get() + w;
+        return len - len % frame;
+      }
+
+      bool commit(int len)
+      {
+        int w = SDL_AtomicGet(&write_pos) + len;
+        if (w >= capacity) { w -= capacity; }
+        SDL_AtomicSet(&write_pos, w);
+        return true;
+      }
+
+      // mixes up to len bytes into stream, returns the mixed length
+      int mix_to(Uint8 *stream, int len, int volume)
+      {
+        if (capacity == 0) { return 0; }
+        int r = SDL_AtomicGet(&read_pos);
+        int filled = get_filled();
+        if (len > filled) { len = filled; }
+        int first = len;
+        if (r + first > capacity) { first = capacity - r; }
+        SDL_MixAudio(stream, buf.get() + r, first, volume);
+        if (len > first) { SDL_MixAudio(stream + first, buf.get(), len - first, volume); }
+        r += len;
+        if (r >= capacity) { r -= capacity; }
+        SDL_AtomicSet(&read_pos, r);
+        return len;
+      }
+
+      // both of the decoder and the callback should be locked out
+      bool reset(int new_capacity = -1, int frame_size = -1)
+      {
+        if (frame_size > 0) { frame = frame_size; }
+        if (new_capacity >= 0)
+        {
+          new_capacity -= new_capacity % frame;
+          buf.reset(new_capacity > 0 ? new Uint8[new_capacity] : NULL);
+          capacity = new_capacity;
+        }
+        SDL_AtomicSet(&read_pos, 0);
+        SDL_AtomicSet(&write_pos, 0);
+        return true;
+      }
+
+      boost::shared_array<Uint8> buf;
+      int capacity;
+      int frame;
+      SDL_atomic_t read_pos, write_pos;
+  };
+
   class sound_loader
   {
     public:
@@ -322,7 +423,7 @@ namespace lev
 //printf("LOAD VORBIS: POS:%d, LEN:%d\n", (int)pos, (int)len);
           count = ov_read(vf, (char *)buf + pos, len - pos,
                           big_endian, word, sign, &current);
-          pos += count;
+          if (count > 0) { pos += count; }
         } while (count > 0);
 //printf("END LOAD VORBIS\n");
 
@@ -395,11 +496,15 @@ namespace lev
     public:
       typedef boost::shared_ptr<impl_sound> ptr;
     protected:
-      impl_sound(SDL_AudioSpec *spec) :
+      impl_sound(SDL_AudioSpec *spec, int buffer_ms) :
         sound(),
         loader(), loop(false),
-        spec(spec), playing(false), volume(1)
-      { }
+        spec(spec), playing(false), volume(1),
+        buffer_ms(buffer_ms), ring()
+      {
+        SDL_AtomicSet(&ended, 0);
+        SDL_AtomicSet(&underruns, 0);
+      }
     public:
       virtual ~impl_sound()
       {
@@ -408,18 +513,21 @@ namespace lev
 
       virtual bool clear()
       {
+        decoder_locker dec_lock;
         audio_locker lock;
         loader.reset();
+        ring.reset(0);
+        SDL_AtomicSet(&ended, 0);
         loop = false;
         playing = false;
         return true;
       }
 
-      static impl_sound::ptr create(SDL_AudioSpec *spec)
+      static impl_sound::ptr create(SDL_AudioSpec *spec, int buffer_ms)
       {
         impl_sound::ptr snd;
         try {
-          snd.reset(new impl_sound(spec));
+          snd.reset(new impl_sound(spec, buffer_ms));
           if (! snd) { throw -1; }
         }
         catch (...) {
@@ -429,8 +537,44 @@ namespace lev
         return snd;
       }
 
+      // called on the decoder thread with decoder_locker held
+      bool decode_ahead()
+      {
+        if (! loader) { return false; }
+        if (SDL_AtomicGet(&ended)) { return false; }
+        bool rewound = false;
+        for ( ; ; )
+        {
+          Uint8 *ptr;
+          int len = ring.get_writable(&ptr);
+          if (len <= 0) { return true; }
+          int loaded = loader->load_samples(ptr, len);
+          if (loaded > 0)
+          {
+            rewound = false;
+            ring.commit(loaded - loaded % ring.frame);
+            continue;
+          }
+          // reached the end, giving up if the rewind gave nothing (e.g. corrupt stream)
+          if (loop && loader->get_length() > 0 && ! rewound)
+          {
+            loader->set_position(0);
+            rewound = true;
+            continue;
+          }
+          SDL_AtomicSet(&ended, 1);
+          return true;
+        }
+      }
+
+      int get_bytes_per_second() const
+      {
+        return spec->freq * spec->channels * sound_loader::get_word_size(spec);
+      }
+
       virtual double get_length()
       {
+        decoder_locker lock;
         if (! loader) { return 0; }
         return loader->get_length();
       }
@@ -444,8 +588,21 @@ namespace lev
 
       virtual double get_position()
       {
+        decoder_locker lock;
         if (! loader) { return 0; }
-        return loader->get_position();
+        // the decoder runs ahead by the buffered samples
+        double pos = loader->get_position() - ring.get_filled() / double(get_bytes_per_second());
+        if (pos < 0)
+        {
+          if (loop) { pos += loader->get_length(); }
+          if (pos < 0) { pos = 0; }
+        }
+        return pos;
+      }
+
+      virtual long get_underruns() const
+      {
+        return SDL_AtomicGet(const_cast<SDL_atomic_t *>(&underruns));
       }
 
       virtual double get_volume() const
@@ -470,7 +627,17 @@ namespace lev
         ld = wav_loader::open(src, spec);
         if (! ld) { ld = vorbis_loader::open(src, spec); }
         if (! ld) { return false; }
+        int frame = spec->channels * sound_loader::get_word_size(spec);
+        if (frame <= 0) { return false; }
+        decoder_locker dec_lock;
         audio_locker lock;
+        try {
+          ring.reset(long(get_bytes_per_second()) * buffer_ms / 1000 + frame, frame);
+        }
+        catch (...) {
+          lev::debug_print("error on sound buffer allocation");
+          return false;
+        }
         loader = ld;
         return true;
       }
@@ -502,7 +669,18 @@ namespace lev
 
       virtual bool set_playing(bool play, bool repeat)
       {
+        decoder_locker dec_lock;
         audio_locker lock;
+        // the decoder latches the end as soon as the file is read through,
+        // starting over if nothing is left or the rest should loop
+        if (play && loader && SDL_AtomicGet(&ended))
+        {
+          if (repeat || ring.get_filled() == 0)
+          {
+            loader->set_position(0);
+            SDL_AtomicSet(&ended, 0);
+          }
+        }
         playing = play;
         loop = repeat;
         return true;
@@ -510,8 +688,12 @@ namespace lev
 
       virtual bool set_position(double s)
       {
+        decoder_locker dec_lock;
         if (! loader) { return false; }
         audio_locker locker;
+        // dropping the samples decoded ahead
+        ring.reset();
+        SDL_AtomicSet(&ended, 0);
         return loader->set_position(s);
       }
 
@@ -528,6 +710,11 @@ namespace lev
       bool playing;
       double volume;
       sound_loader::ptr loader;
+      // samples decoded ahead by the decoder thread
+      int buffer_ms;
+      sample_ring ring;
+      SDL_atomic_t ended;
+      SDL_atomic_t underruns;
   };
 
   // mixer class implementation
@@ -537,12 +724,22 @@ namespace lev
       typedef boost::shared_ptr<mixer_core> ptr;
     protected:
       mixer_core() :
-        active(false), slots()
-      { }
+        active(false), slots(),
+        buffer_ms(500),
+        decoder(NULL), wake(NULL)
+      {
+        SDL_AtomicSet(&decoding, 0);
+        SDL_AtomicSet(&underruns, 0);
+      }
     public:
       virtual ~mixer_core()
       {
-        slots.clear();
+        stop_decoder();
+        {
+          decoder_locker dec_lock;
+          audio_locker lock;
+          slots.clear();
+        }
 //        if (system::get_interpreter())
 //        {
 //printf("CLOSING AUDIO!\n");
@@ -551,6 +748,7 @@ namespace lev
 //        }
       }
 
+      // only mixing the samples decoded ahead, never decoding here
       static void audio_callback(void *udata, Uint8 *stream, int len)
       {
         mixer_core::ptr mx = mixer_core::singleton;
@@ -561,22 +759,20 @@ namespace lev
         for (i = mx->slots.begin(); i != mx->slots.end(); i++)
         {
           if (! i->second) { continue; }
-          impl_sound::ptr snd = i->second;
+          impl_sound *snd = i->second.get();
           if (! snd->playing) { continue; }
-          if (! snd->loader) { continue; }
-          Uint8 buf[len];
-          memset(buf, len, 0);
-          int loaded = snd->loader->load_samples(buf, len);
-          if (loaded > 0)
-          {
-            SDL_MixAudio(stream, buf, len, SDL_MIX_MAXVOLUME * snd->volume);
-          }
-          else
+          int mixed = snd->ring.mix_to(stream, len, SDL_MIX_MAXVOLUME * snd->volume);
+          if (mixed < len)
           {
-            if (snd->loop) { snd->set_position(0); }
-            else { snd->playing = false; }
+            if (SDL_AtomicGet(&snd->ended)) { snd->playing = false; }
+            else if (snd->loader)
+            {
+              SDL_AtomicAdd(&snd->underruns, 1);
+              SDL_AtomicAdd(&mx->underruns, 1);
+            }
           }
         }
+        if (mx->wake && SDL_SemValue(mx->wake) == 0) { SDL_SemPost(mx->wake); }
       }
 
       static mixer_core::ptr create()
@@ -593,6 +789,7 @@ namespace lev
           request.callback = mixer_core::audio_callback;
           request.userdata = singleton.get();
           if (SDL_OpenAudio(&request, &singleton->spec) < 0) { throw -2; }
+          if (! singleton->start_decoder()) { throw -3; }
           SDL_PauseAudio(0);
           singleton->active = true;
         }
@@ -603,9 +800,66 @@ namespace lev
         return singleton;
       }
 
+      static int decoder_main(void *udata)
+      {
+        mixer_core *mx = (mixer_core *)udata;
+        while (SDL_AtomicGet(&mx->decoding))
+        {
+          {
+            decoder_locker lock;
+            std::map<int, impl_sound::ptr>::iterator i;
+            for (i = mx->slots.begin(); i != mx->slots.end(); i++)
+            {
+              if (i->second) { i->second->decode_ahead(); }
+            }
+          }
+          // woken up by the audio callback after consuming
+          SDL_SemWaitTimeout(mx->wake, 10);
+        }
+        return 0;
+      }
+
+      bool start_decoder()
+      {
+        wake = SDL_CreateSemaphore(0);
+        if (! wake) { return false; }
+        SDL_AtomicSet(&decoding, 1);
+        decoder = SDL_CreateThread(mixer_core::decoder_main, "lev.decoder", this);
+        if (! decoder)
+        {
+          SDL_AtomicSet(&decoding, 0);
+          return false;
+        }
+        return true;
+      }
+
+      bool stop_decoder()
+      {
+        if (decoder)
+        {
+          SDL_AtomicSet(&decoding, 0);
+          SDL_SemPost(wake);
+          SDL_WaitThread(decoder, NULL);
+          decoder = NULL;
+        }
+        if (wake)
+        {
+          audio_locker lock;
+          SDL_DestroySemaphore(wake);
+          wake = NULL;
+        }
+        return true;
+      }
+
       bool active;
       SDL_AudioSpec spec;
       std::map<int, impl_sound::ptr> slots;
+      // decoding ahead
+      int buffer_ms;
+      SDL_Thread *decoder;
+      SDL_sem *wake;
+      SDL_atomic_t decoding;
+      SDL_atomic_t underruns;
       // singleton
       static mixer_core::ptr singleton;
   };
@@ -639,6 +893,7 @@ namespace lev
         found = core->slots.find(slot_num);
         if (found != core->slots.end())
         {
+          decoder_locker dec_lock;
           audio_locker lock;
           core->slots.erase(found);
           return true;
@@ -663,8 +918,9 @@ printf("MIXER SINGLETON CLEAR\n");
       {
         impl_sound::ptr slot;
         try {
-          slot = impl_sound::create(&core->spec);
+          slot = impl_sound::create(&core->spec, core->buffer_ms);
           if (! slot) { throw -1; }
+          decoder_locker dec_lock;
           audio_locker lock;
           core->slots[slot_num] = slot;
         }
@@ -704,6 +960,11 @@ printf("MIXER SINGLETON CLEAR\n");
         }
       }
 
+      virtual int get_buffer_length() const
+      {
+        return core->buffer_ms;
+      }
+
       virtual int get_channels() const
       {
         return core->spec.channels;
@@ -765,11 +1026,29 @@ printf("GET MIXER CORE COUNT: %ld\n", mx->core.use_count());
         return mx;
       }
 
+      virtual long get_underruns() const
+      {
+        return SDL_AtomicGet(&core->underruns);
+      }
+
       virtual bool is_active() const
       {
         return core->active;
       }
 
+      virtual bool set_buffer_length(int ms)
+      {
+        if (ms <= 0) { return false; }
+        // applied to the sounds opened after
+        core->buffer_ms = ms;
+        std::map<int, impl_sound::ptr>::iterator i;
+        for (i = core->slots.begin(); i != core->slots.end(); i++)
+        {
+          if (i->second) { i->second->buffer_ms = ms; }
+        }
+        return true;
+      }
+
       mixer_core::ptr core;
   };
 
@@ -18,12 +18,15 @@
 #include "lev/debug.hpp"
 #include "lev/draw.hpp"
 #include "lev/entry.hpp"
+#include "lev/loader.hpp"
+#include "lev/profiler.hpp"
 #include "lev/screen.hpp"
 #include "lev/sound.hpp"
 #include "lev/timer.hpp"
 #include "lev/util.hpp"
 
 // libraries
+#include <algorithm>
 #include <boost/weak_ptr.hpp>
 #include <map>
 #include <luabind/luabind.hpp>
@@ -76,6 +79,7 @@ int luaopen_lev_system(lua_State *L)
         .property("y", &event::get_y)
         .property("yrel", &event::get_dy),
       class_<lev::system, base, boost::shared_ptr<base> >("system")
+        .property("alpha", &system::get_alpha)
         .def("close", &system::close)
         .def("create_mixer", &mixer::init)
         .property("dbg", &system::get_debugger)
@@ -84,13 +88,16 @@ int luaopen_lev_system(lua_State *L)
         .def("do_event", &system::do_event)
         .def("do_events", &system::do_events)
         .def("done", &system::close)
+        .property("coalesce_motion", &system::is_coalescing_motion, &system::set_coalescing_motion)
         .property("elapsed", &system::get_elapsed)
+        .property("fps", &system::get_fps, &system::set_fps)
         .property("is_debugging", &system::is_debugging)
         .property("is_running", &system::is_running, &system::set_running)
         .def("mixer", &mixer::init)
         .property("name", &system::get_name, &system::set_name)
         .property("on_button_down", &system::get_on_button_down, &system::set_on_button_down)
         .property("on_button_up", &system::get_on_button_up, &system::set_on_button_up)
+        .property("on_events", &system::get_on_events, &system::set_on_events)
         .property("on_idle", &system::get_on_idle, &system::set_on_idle)
         .property("on_key_down", &system::get_on_key_down, &system::set_on_key_down)
         .property("on_key_up", &system::get_on_key_up, &system::set_on_key_up)
@@ -102,6 +109,7 @@ int luaopen_lev_system(lua_State *L)
         .property("on_quit", &system::get_on_quit, &system::set_on_quit)
         .property("on_right_down", &system::get_on_right_down, &system::set_on_right_down)
         .property("on_right_up", &system::get_on_right_up, &system::set_on_right_up)
+        .property("on_update", &system::get_on_update, &system::set_on_update)
         .def("quit", &system::quit)
         .def("quit", &system::quit0)
         .def("run", &system::run)
@@ -109,6 +117,8 @@ int luaopen_lev_system(lua_State *L)
         .def("start_debug", &system::start_debug)
         .def("stop_debug", &system::stop_debug)
         .property("time", &system::get_elapsed)
+        .property("update_rate", &system::get_update_rate, &system::set_update_rate)
+        .property("vsync", &system::is_vsync, &system::set_vsync)
         .scope
         [
           def("get", &system::get),
@@ -130,6 +140,22 @@ int luaopen_lev_system(lua_State *L)
 namespace lev
 {
 
+  int input::to_slot(unsigned long type)
+  {
+    switch (type)
+    {
+      case SDL_KEYDOWN:         return LEV_EVENT_KEY_DOWN;
+      case SDL_KEYUP:           return LEV_EVENT_KEY_UP;
+      case SDL_MOUSEBUTTONDOWN: return LEV_EVENT_BUTTON_DOWN;
+      case SDL_MOUSEBUTTONUP:   return LEV_EVENT_BUTTON_UP;
+      case SDL_MOUSEMOTION:     return LEV_EVENT_MOTION;
+      case SDL_MOUSEWHEEL:      return LEV_EVENT_WHEEL;
+      case SDL_QUIT:            return LEV_EVENT_QUIT;
+      case SDL_WINDOWEVENT:     return LEV_EVENT_WINDOW;
+      default:                  return LEV_EVENT_NONE;
+    }
+  }
+
   const char *input::to_keyname(long code)
   {
     static std::map<long, std::string> *keymap = NULL;
@@ -590,21 +616,36 @@ namespace lev
       SDL_Event evt;
   };
 
+  // entry of the timer queue, outdated entries are dropped when they come up
+  struct timer_entry
+  {
+    double deadline;
+    boost::weak_ptr<timer> t;
+
+    // the heap keeps the earliest deadline at the front
+    bool operator < (const timer_entry &rhs) const { return deadline > rhs.deadline; }
+  };
+
   class system_core
   {
     public:
       typedef boost::shared_ptr<system_core> ptr;
       static system_core::ptr singleton;
+      enum { EVENT_POOL_SIZE = 32 };
     protected:
       system_core(lua_State *L) :
+        coalesce_motion(false),
         dbg(),
-        funcs(), name("lev"), running(true),
-        on_idle(),
+        evt_list(), evt_list_size(0), evt_pool(), evt_view(), evt_views(),
+        fps(0), funcs(), ldr(), name("lev"), running(true),
+        on_events(), on_idle(), on_update(),
         on_left_down(),   on_left_up(),
         on_middle_down(), on_middle_up(),
         on_right_down(),  on_right_up(),
         screens(),
+        step_clock(),
         timers(),
+        vsync(false),
         L(L)
       { }
     public:
@@ -634,6 +675,13 @@ printf("INITTED!\n");
 
           singleton->evt = impl_event::create();
           if (! singleton->evt) { throw -3; }
+          // events for the batched delivery, reused on each do_events
+          for (int i = 0; i < EVENT_POOL_SIZE; i++)
+          {
+            impl_event::ptr e = impl_event::create();
+            if (! e) { throw -4; }
+            singleton->evt_pool.push_back(e);
+          }
         }
         catch (...) {
           singleton.reset();
@@ -656,17 +704,33 @@ printf("QUITING3\n");
       }
 
       lua_State *L;
+      bool coalesce_motion;
       debugger::ptr dbg;
-      std::map<Uint32, luabind::object> funcs;
+      double fps;
+      // system callbacks indexed by the event slot
+      luabind::object funcs[LEV_EVENT_SLOTS];
+      boost::weak_ptr<loader> ldr;
       std::string name;
+      luabind::object on_events;
       luabind::object on_idle;
       luabind::object on_left_down,   on_left_up;
       luabind::object on_middle_down, on_middle_up;
       luabind::object on_right_down,  on_right_up;
+      luabind::object on_update;
       std::map<Uint32, boost::weak_ptr<screen> > screens;
-      std::vector<boost::weak_ptr<timer> > timers;
+      // ticking on_update at the fixed timestep
+      clock::ptr step_clock;
+      // min-heap by the deadline
+      std::vector<timer_entry> timers;
       impl_event::ptr evt;
+      // Lua objects of the pooled events, created once and passed on each dispatch
+      luabind::object evt_list;
+      int evt_list_size;
+      std::vector<impl_event::ptr> evt_pool;
+      luabind::object evt_view;
+      std::vector<luabind::object> evt_views;
       bool running;
+      bool vsync;
   };
   system_core::ptr system_core::singleton;
 
@@ -690,6 +754,13 @@ printf("QUITING3\n");
         return true;
       }
 
+      virtual bool attach(boost::shared_ptr<loader> l)
+      {
+        if (! core || ! l) { return false; }
+        core->ldr = l;
+        return true;
+      }
+
       virtual bool attach(boost::shared_ptr<screen> s)
       {
         if (! core) { return false; }
@@ -705,8 +776,13 @@ printf("QUITING3\n");
       {
         if (! core) { return false; }
         if (! t) { return false; }
-printf("ATTACH TIMER!\n");
-        core->timers.push_back(t);
+        timer_entry entry;
+        entry.deadline = t->get_deadline();
+        // stopped timers are put again on start
+        if (entry.deadline < 0) { return true; }
+        entry.t = t;
+        core->timers.push_back(entry);
+        std::push_heap(core->timers.begin(), core->timers.end());
         return true;
       }
 
@@ -735,37 +811,107 @@ printf("SINGLETON CLEAR!\n");
       {
         if (! core) { return false; }
 
-        std::vector<boost::weak_ptr<timer> >::iterator i = core->timers.begin();
-        for ( ; i != core->timers.end(); i++)
+        probe_timers();
+
+        // finished asynchronous loads are delivered on the main thread
+        if (loader::ptr l = core->ldr.lock())
         {
-          if (boost::shared_ptr<timer> t = i->lock())
-          {
-//printf("PROVING!\n");
-            t->probe();
-          }
-          else
+          l->poll();
+        }
+
+        SDL_Event &e = core->evt->evt;
+        if (poll_event(e))
+        {
+          luabind::object f = find_handler(e);
+          if (f.is_valid() && luabind::type(f) == LUA_TFUNCTION)
           {
-//printf("DETACHING TIMER!\n");
-            core->timers.erase(i);
-            break;
+            try {
+              // the same object on every call, clone to keep the event
+              if (! core->evt_view.is_valid())
+              {
+                core->evt_view = luabind::object(core->L, event::ptr(core->evt));
+              }
+              f(core->evt_view);
+            }
+            catch (...) {
+              lev::debug_print(lua_tostring(core->L, -1));
+              lev::debug_print("error on event processing\n");
+            }
           }
+          return true;
         }
+        return false;
+      }
 
-        SDL_Event &e = core->evt->evt;
-        if (SDL_PollEvent(&e))
+      virtual bool do_events()
+      {
+        if (! core) { return false; }
+        if (! core->on_events || luabind::type(core->on_events) != LUA_TFUNCTION)
         {
-          luabind::object f;
+          while (do_event()) { }
+          return true;
+        }
 
-          if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP)
+        // batched delivery, all pending events in one call
+        probe_timers();
+        if (loader::ptr l = core->ldr.lock())
+        {
+          l->poll();
+        }
+        if (! core->evt_list.is_valid()) { core->evt_list = luabind::newtable(core->L); }
+        luabind::object &list = core->evt_list;
+        int count = 0;
+        SDL_Event &e = core->evt->evt;
+        while (poll_event(e))
+        {
+          luabind::object f = find_handler(e);
+          luabind::object view = get_pooled_event(count);
+          if (! view.is_valid()) { break; }
+          core->evt_pool[count]->evt = e;
+          list[++count] = view;
+          // the own handlers (on_close, on_quit, keys...) are still called on the way
+          if (f.is_valid() && luabind::type(f) == LUA_TFUNCTION)
           {
+            try {
+              f(view);
+            }
+            catch (...) {
+              lev::debug_print(lua_tostring(core->L, -1));
+              lev::debug_print("error on event processing\n");
+            }
+          }
+        }
+        // the list table is reused too, clearing the rest of the last delivery
+        for (int i = count + 1; i <= core->evt_list_size; i++) { list[i] = luabind::nil; }
+        core->evt_list_size = count;
+        if (count == 0) { return true; }
+        try {
+          core->on_events(list);
+        }
+        catch (...) {
+          lev::debug_print(lua_tostring(core->L, -1));
+          lev::debug_print("error on event processing\n");
+        }
+        return true;
+      }
+
+      // finding the callback of the event, the default action is done if none is set
+      luabind::object find_handler(SDL_Event &e)
+      {
+        luabind::object f;
+        const int slot = input::to_slot(e.type);
+        switch (slot)
+        {
+          case LEV_EVENT_KEY_DOWN:
+          case LEV_EVENT_KEY_UP:
             if (screen::ptr s = core->screens[e.key.windowID].lock())
             {
-              if (e.type == SDL_KEYDOWN) { f = s->get_on_key_down(); }
+              if (slot == LEV_EVENT_KEY_DOWN) { f = s->get_on_key_down(); }
               else { f = s->get_on_key_up(); }
             }
-          }
-          else if (e.type == SDL_MOUSEBUTTONDOWN ||
-                   e.type == SDL_MOUSEBUTTONUP)
+            break;
+          case LEV_EVENT_BUTTON_DOWN:
+          case LEV_EVENT_BUTTON_UP:
           {
             SDL_MouseButtonEvent &btn = e.button;
             if (screen::ptr s = core->screens[e.button.windowID].lock())
@@ -804,77 +950,132 @@ printf("SINGLETON CLEAR!\n");
                 else if (btn.state == SDL_RELEASED) { f = core->on_right_up; }
               }
             }
+            break;
           }
-          else if (e.type == SDL_MOUSEMOTION)
-          {
+          case LEV_EVENT_MOTION:
             if (screen::ptr s = core->screens[e.motion.windowID].lock())
             {
               f = s->get_on_motion();
             }
-          }
-          else if (e.type == SDL_MOUSEWHEEL)
-          {
+            break;
+          case LEV_EVENT_WHEEL:
             if (screen::ptr s = core->screens[e.wheel.windowID].lock())
             {
               f = s->get_on_wheel();
             }
-          }
-          else if (e.type == SDL_WINDOWEVENT)
-          {
+            break;
+          case LEV_EVENT_WINDOW:
+            if (e.window.event != SDL_WINDOWEVENT_CLOSE) { break; }
             if (screen::ptr s = core->screens[e.window.windowID].lock())
             {
-              if (e.window.event == SDL_WINDOWEVENT_CLOSE)
+              f = s->get_on_close();
+              if (! f.is_valid())
               {
-                f = s->get_on_close();
-                if (! f.is_valid())
+                if (core->dbg && s == core->dbg->get_screen())
+                {
+                  // debug window
+                  s->hide();
+                }
+                else
                 {
-                  if (core->dbg && s == core->dbg->get_screen())
-                  {
-                    // debug window
-                    s->hide();
-                  }
-                  else
-                  {
-                    // normal window
-                    s->close();
-                  }
+                  // normal window
+                  s->close();
                 }
               }
             }
-          }
-          else if (e.type == SDL_QUIT)
-          {
-            f = core->funcs[SDL_QUIT];
+            break;
+          case LEV_EVENT_QUIT:
+            f = core->funcs[LEV_EVENT_QUIT];
             if (! f.is_valid()) { set_running(false); }
-          }
-          else
-          {
+            break;
+          default:
             // OTHERS
-          }
+            return f;
+        }
 
-          if (! f.is_valid())
-          {
-            f = core->funcs[e.type];
-          }
-          if (f.is_valid() && luabind::type(f) == LUA_TFUNCTION)
-          {
-            try {
-              f(event::ptr(core->evt));
-            }
-            catch (...) {
-              lev::debug_print(lua_tostring(core->L, -1));
-              lev::debug_print("error on event processing\n");
-            }
-          }
-          return true;
+        if (! f.is_valid())
+        {
+          f = core->funcs[slot];
         }
-        return false;
+        return f;
       }
 
-      virtual bool do_events()
+      // Lua object of the i-th pooled event, growing the pool if needed
+      luabind::object get_pooled_event(int i)
+      {
+        while (core->evt_pool.size() <= i)
+        {
+          impl_event::ptr e = impl_event::create();
+          if (! e) { return luabind::object(); }
+          core->evt_pool.push_back(e);
+        }
+        while (core->evt_views.size() <= i)
+        {
+          event::ptr e = core->evt_pool[core->evt_views.size()];
+          core->evt_views.push_back(luabind::object(core->L, e));
+        }
+        return core->evt_views[i];
+      }
+
+      virtual luabind::object get_on_events()
+      {
+        if (! core) { return luabind::object(); }
+        return core->on_events;
+      }
+
+      virtual bool is_coalescing_motion() const
       {
         if (! core) { return false; }
-        while (do_event()) { }
+        return core->coalesce_motion;
+      }
+
+      // polling the next event, merging the following motion events if coalescing
+      bool poll_event(SDL_Event &e)
+      {
+        if (! SDL_PollEvent(&e)) { return false; }
+        if (e.type != SDL_MOUSEMOTION || ! core->coalesce_motion) { return true; }
+        SDL_Event next;
+        while (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) == 1)
+        {
+          // merging only the immediately following motions of the same window
+          if (next.type != SDL_MOUSEMOTION) { break; }
+          if (next.motion.windowID != e.motion.windowID) { break; }
+          if (next.motion.which != e.motion.which) { break; }
+          SDL_PeepEvents(&next, 1, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION);
+          next.motion.xrel += e.motion.xrel;
+          next.motion.yrel += e.motion.yrel;
+          e = next;
+        }
+        return true;
+      }
+
+      // firing the due timers in deadline order, dropping the dead and outdated entries
+      bool probe_timers()
+      {
+        if (core->timers.empty()) { return false; }
+        const double now = get_elapsed();
+        std::vector<timer_entry> due;
+        while (! core->timers.empty() && core->timers.front().deadline <= now)
+        {
+          std::pop_heap(core->timers.begin(), core->timers.end());
+          due.push_back(core->timers.back());
+          core->timers.pop_back();
+        }
+        for (int i = 0; i < due.size(); i++)
+        {
+          timer::ptr t = due[i].t.lock();
+          if (! t) { continue; }
+          // the step clock is ticked only by step(), before on_idle
+          if (t == core->step_clock) { continue; }
+          // stopped or rescheduled since queued, the current deadline has its own entry
+          if (t->get_deadline() != due[i].deadline) { continue; }
+          if (! t->probe())
+          {
+            // not fired yet (clocks wait for strictly exceeding), retrying on the next poll
+            core->timers.push_back(due[i]);
+            std::push_heap(core->timers.begin(), core->timers.end());
+          }
+        }
         return true;
       }
 
@@ -895,12 +1096,24 @@ printf("SINGLETON CLEAR!\n");
         return sys;
       }
 
+      virtual double get_alpha() const
+      {
+        if (! core || ! core->step_clock) { return 1; }
+        return core->step_clock->get_alpha();
+      }
+
       virtual debugger::ptr get_debugger()
       {
         if (! core) { return debugger::ptr(); }
         return core->dbg;
       }
 
+      virtual double get_fps() const
+      {
+        if (! core) { return 0; }
+        return core->fps;
+      }
+
       virtual std::string get_name() const
       {
         if (! core) { return ""; }
@@ -910,25 +1123,25 @@ printf("SINGLETON CLEAR!\n");
       virtual luabind::object get_on_button_down()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_MOUSEBUTTONDOWN];
+        return core->funcs[LEV_EVENT_BUTTON_DOWN];
       }
 
       virtual luabind::object get_on_button_up()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_MOUSEBUTTONUP];
+        return core->funcs[LEV_EVENT_BUTTON_UP];
       }
 
       virtual luabind::object get_on_key_down()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_KEYDOWN];
+        return core->funcs[LEV_EVENT_KEY_DOWN];
       }
 
       virtual luabind::object get_on_key_up()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_KEYUP];
+        return core->funcs[LEV_EVENT_KEY_UP];
       }
 
       virtual luabind::object get_on_left_down()
@@ -958,13 +1171,13 @@ printf("SINGLETON CLEAR!\n");
       virtual luabind::object get_on_motion()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_MOUSEMOTION];
+        return core->funcs[LEV_EVENT_MOTION];
       }
 
       virtual luabind::object get_on_quit()
       {
         if (! core) { return luabind::object(); }
-        return core->funcs[SDL_QUIT];
+        return core->funcs[LEV_EVENT_QUIT];
       }
 
       virtual luabind::object get_on_right_down()
@@ -985,11 +1198,23 @@ printf("SINGLETON CLEAR!\n");
         return core->on_idle;
       }
 
+      virtual luabind::object get_on_update()
+      {
+        if (! core) { return luabind::object(); }
+        return core->on_update;
+      }
+
       virtual double get_elapsed() const
       {
         return double(SDL_GetPerformanceCounter()) / SDL_GetPerformanceFrequency();
       }
 
+      virtual double get_update_rate() const
+      {
+        if (! core || ! core->step_clock) { return 0; }
+        return core->step_clock->get_freq();
+      }
+
       static impl_system::ptr init(lua_State *L)
       {
         impl_system::ptr sys;
@@ -1020,6 +1245,12 @@ printf("SINGLETON CLEAR!\n");
         return core->running;
       }
 
+      virtual bool is_vsync() const
+      {
+        if (! core) { return false; }
+        return core->vsync;
+      }
+
       virtual bool quit(bool force)
       {
         if (force)
@@ -1039,25 +1270,65 @@ printf("SINGLETON CLEAR!\n");
       {
         if (! core) { return false; }
         core->running = true;
+        Uint64 deadline = SDL_GetPerformanceCounter();
         while (is_running())
         {
           try {
+            step();
             if (core->on_idle && luabind::type(core->on_idle) == LUA_TFUNCTION)
             {
+              LEV_PROFILE_ZONE("on_idle");
               core->on_idle();
     //          safe_call(core->on_idle);
             }
-            do_events();
+            {
+              LEV_PROFILE_ZONE("do_events");
+              do_events();
+            }
+            if (profiler::is_enabled()) { profiler::get()->end_frame(); }
           }
           catch (...) {
             lev::debug_print(lua_tostring(core->L, -1));
             lev::debug_print("error on system::run");
             return false;
           }
+
+          // frame pacing, otherwise looping as fast as possible (or as vsync allows)
+          if (core && core->fps > 0)
+          {
+            const Uint64 period = SDL_GetPerformanceFrequency() / core->fps;
+            deadline += period;
+            Uint64 now = SDL_GetPerformanceCounter();
+            if (now > deadline + period)
+            {
+              // missed by more than a frame, not to rush for catching up
+              deadline = now;
+            }
+            else
+            {
+              LEV_PROFILE_ZONE("sleep");
+              sleep_until(deadline);
+            }
+          }
         }
         return true;
       }
 
+      virtual bool set_coalescing_motion(bool coalesce)
+      {
+        if (! core) { return false; }
+        core->coalesce_motion = coalesce;
+        return true;
+      }
+
+      virtual bool set_fps(double fps)
+      {
+        if (! core) { return false; }
+        if (fps < 0) { return false; }
+        core->fps = fps;
+        return true;
+      }
+
       virtual bool set_name(const std::string &name)
       {
         if (! core) { return false; }
@@ -1068,28 +1339,28 @@ printf("SINGLETON CLEAR!\n");
       virtual bool set_on_button_down(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_MOUSEBUTTONDOWN] = func;
+        core->funcs[LEV_EVENT_BUTTON_DOWN] = func;
         return true;
       }
 
       virtual bool set_on_button_up(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_MOUSEBUTTONUP] = func;
+        core->funcs[LEV_EVENT_BUTTON_UP] = func;
         return true;
       }
 
       virtual bool set_on_key_down(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_KEYDOWN] = func;
+        core->funcs[LEV_EVENT_KEY_DOWN] = func;
         return true;
       }
 
       virtual bool set_on_key_up(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_KEYUP] = func;
+        core->funcs[LEV_EVENT_KEY_UP] = func;
         return true;
       }
 
@@ -1124,14 +1395,14 @@ printf("SINGLETON CLEAR!\n");
       virtual bool set_on_motion(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_MOUSEMOTION] = func;
+        core->funcs[LEV_EVENT_MOTION] = func;
         return true;
       }
 
       virtual bool set_on_quit(luabind::object func)
       {
         if (! core) { return false; }
-        core->funcs[SDL_QUIT] = func;
+        core->funcs[LEV_EVENT_QUIT] = func;
         return true;
       }
 
@@ -1149,6 +1420,13 @@ printf("SINGLETON CLEAR!\n");
         return true;
       }
 
+      virtual bool set_on_events(luabind::object func)
+      {
+        if (! core) { return false; }
+        core->on_events = func;
+        return true;
+      }
+
       virtual bool set_on_idle(luabind::object func)
       {
         if (! core) { return false; }
@@ -1156,6 +1434,14 @@ printf("SINGLETON CLEAR!\n");
         return true;
       }
 
+      virtual bool set_on_update(luabind::object func)
+      {
+        if (! core) { return false; }
+        core->on_update = func;
+        if (core->step_clock) { core->step_clock->set_notify(func); }
+        return true;
+      }
+
       virtual bool set_running(bool run)
       {
         if (! core) { return false; }
@@ -1163,6 +1449,76 @@ printf("SINGLETON CLEAR!\n");
         return true;
       }
 
+      virtual bool set_update_rate(double rate)
+      {
+        if (! core) { return false; }
+        if (rate < 0) { return false; }
+        if (rate == 0)
+        {
+          if (core->step_clock) { core->step_clock->stop(); }
+          core->step_clock.reset();
+          return true;
+        }
+        if (! core->step_clock)
+        {
+          core->step_clock = clock::create(rate);
+          if (! core->step_clock) { return false; }
+          core->step_clock->set_notify(core->on_update);
+          return true;
+        }
+        return core->step_clock->set_freq(rate);
+      }
+
+      virtual bool set_vsync(bool enable)
+      {
+        if (! core) { return false; }
+        core->vsync = enable;
+        // the swap interval belongs to each GL context
+        std::map<Uint32, boost::weak_ptr<screen> >::iterator i = core->screens.begin();
+        for ( ; i != core->screens.end(); i++)
+        {
+          if (screen::ptr s = i->second.lock())
+          {
+            s->set_current();
+            SDL_GL_SetSwapInterval(enable ? 1 : 0);
+          }
+        }
+        return true;
+      }
+
+      // sleeping until the deadline of the performance counter, spinning the last moment
+      static bool sleep_until(Uint64 deadline)
+      {
+        const Uint64 freq = SDL_GetPerformanceFrequency();
+        for ( ; ; )
+        {
+          Uint64 now = SDL_GetPerformanceCounter();
+          if (now >= deadline) { return true; }
+          Uint64 rest_ms = (deadline - now) * 1000 / freq;
+          // SDL_Delay may oversleep by the granularity of the OS scheduler
+          if (rest_ms > 2) { SDL_Delay(rest_ms - 2); }
+          else { SDL_Delay(0); }
+        }
+      }
+
+      // running the fixed updates due, giving up the catch-up after max_steps
+      bool step(int max_steps = 5)
+      {
+        if (! core || ! core->step_clock) { return false; }
+        LEV_PROFILE_ZONE("on_update");
+        int steps = 0;
+        while (core->step_clock->probe())
+        {
+          if (++steps >= max_steps)
+          {
+            // too far behind (e.g. after a stall), restarting from now
+            core->step_clock->start(-1);
+            break;
+          }
+        }
+        return true;
+      }
+
       virtual debugger::ptr start_debug()
       {
         return debugger::start();
@@ -16,6 +16,7 @@
 
 // dependencies
 #include "lev/debug.hpp"
+#include "lev/profiler.hpp"
 #include "lev/system.hpp"
 
 // libraries
@@ -74,6 +75,7 @@ int luaopen_lev_timer(lua_State *L)
           def("create", &timer::create)
         ],
       class_<lev::clock, timer, boost::shared_ptr<base> >("clock")
+        .property("alpha", &clock::get_alpha)
         .property("fps", &clock::get_freq, &clock::set_freq)
         .property("freq", &clock::get_freq, &clock::set_freq)
         .property("frequency", &clock::get_freq, &clock::set_freq)
@@ -238,8 +240,7 @@ namespace lev
           t.reset(new impl_timer);
           if (! t) { throw -1; }
           t->wptr = t;
-          t->start(interval, false);
-          if (! sys->attach(t->to_timer())) { throw -2; }
+          if (! t->start(interval, false)) { throw -2; }
         }
         catch (...) {
           t.reset();
@@ -248,6 +249,12 @@ namespace lev
         return t;
       }
 
+      virtual double get_deadline() const
+      {
+        if (! running) { return -1; }
+        return base_time + interval;
+      }
+
       virtual double get_interval() const
       {
         return interval;
@@ -272,6 +279,7 @@ namespace lev
       {
         if (func_notify && luabind::type(func_notify) == LUA_TFUNCTION)
         {
+          LEV_PROFILE_ZONE("on_tick");
           func_notify();
           return true;
         }
@@ -288,15 +296,28 @@ namespace lev
           notify();
           base_time = sys->get_elapsed();
           if (one_shot) { running = false; }
+          schedule();
           return true;
         }
         return false;
       }
 
+      // putting on the timer queue of the system, after each change of the deadline
+      bool schedule()
+      {
+        if (! running) { return false; }
+        system::ptr sys = system::get();
+        if (! sys) { return false; }
+        timer::ptr t = wptr.lock();
+        if (! t) { return false; }
+        return sys->attach(t);
+      }
+
       virtual bool set_interval(double new_interval)
       {
         if (new_interval < 0) { return false; }
         interval = new_interval;
+        schedule();
         return true;
       }
 
@@ -315,7 +336,7 @@ namespace lev
         base_time = sys->get_elapsed();
         one_shot = new_one_shot;
         running = true;
-        return true;
+        return schedule();
       }
 
       virtual bool stop()
@@ -361,8 +382,7 @@ namespace lev
           c.reset(new impl_clock);
           if (! c) { throw -1; }
           c->wptr = c;
-          c->start(freq);
-          if (! sys->attach(c->to_timer())) { throw -1; }
+          if (! c->start(freq)) { throw -2; }
         }
         catch (...) {
           c.reset();
@@ -371,6 +391,17 @@ namespace lev
         return c;
       }
 
+      virtual double get_alpha() const
+      {
+        if (! running || interval <= 0) { return 0; }
+        system::ptr sys = system::get();
+        if (! sys) { return 0; }
+        double alpha = (sys->get_elapsed() - base_time) / interval;
+        if (alpha < 0) { return 0; }
+        if (alpha > 1) { return 1; }
+        return alpha;
+      }
+
       virtual double get_freq() const
       {
         return 1.0 / get_interval();
@@ -386,8 +417,10 @@ namespace lev
           base_time = base_time + interval;
           notify();
           if (one_shot) { running = false; }
+          schedule();
           return true;
         }
+        return false;
       }
 
       virtual bool set_freq(double freq)
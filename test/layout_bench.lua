@@ -0,0 +1,51 @@
+require 'lev.std'
+require 'debug'
+
+local words = { 'Hello,', 'World!', '日本語', 'layout', 'benchmark' }
+
+lay = lev.layout(600)
+local f = lev.font('fonts/default.ttf')
+if f then
+  lay.font = f
+  lay.font.size = 20
+end
+
+sw = lev.stop_watch()
+sw:start()
+for i = 1, 10000 do
+  lay:reserve_word(words[i % #words + 1])
+  if i % 100 == 0 then
+    lay:reserve_new_line()
+  end
+end
+print('RESERVE 10000 WORDS', sw.time)
+
+sw:start()
+for i = 1, 1000 do
+  local w, h = lay.w, lay.h
+end
+print('1000 SIZE QUERIES', sw.time, lay.w, lay.h)
+
+sw:start()
+lay:rearrange()
+print('REARRANGE', sw.time)
+
+sw:start()
+lay:complete()
+print('COMPLETE', sw.time)
+
+screen = lev.screen('Layout Benchmark', 640, 480)
+lay:texturize()
+local frames = 0
+system.on_tick = function()
+  sw:start()
+  screen:clear()
+  screen:draw(lay, 10, 480 - lay.h)
+  screen:swap()
+  frames = frames + 1
+  print('FRAME', frames, sw.time)
+  if frames >= 100 then system:quit() end
+end
+
+system:run()
+
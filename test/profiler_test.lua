@@ -0,0 +1,33 @@
+require 'lev.std'
+
+prof = lev.profiler()
+prof.enabled = true
+prof:start_trace()
+
+screen = lev.screen('Profiler Test', 640, 480)
+bmp = lev.bitmap(64, 64)
+local frames = 0
+
+system.on_idle = function()
+  prof:zone('lua_draw', function()
+    screen:clear()
+    bmp:set_pixel(frames % 64, frames % 64, lev.color(255, 0, 0))
+    screen:draw(bmp, 100, 100)
+  end)
+  screen:swap()
+  frames = frames + 1
+  if frames >= 300 then system:quit() end
+end
+
+system:run()
+
+prof:stop_trace()
+prof:save_trace('profile.json')
+local limits = prof:get_limits()
+for _, zone in ipairs(prof:get_zones()) do
+  print(zone, 'avg', prof:average(zone), 'last', prof:last(zone))
+  local hist = prof:histogram(zone)
+  for i, count in ipairs(hist) do
+    print('', '<' .. (limits[i] or 'inf') .. 'ms', count)
+  end
+end